@@ -86,6 +86,9 @@ Client::Client(const char *worldId, const char *serverAddress) {
 		playingState->init(conf->last_world_id);
 		stateMachine->push(playingState);
 	}
+	// the world couldn't be opened, nothing more to set up
+	if (closeRequested)
+		return;
 
 #define START_APPLICATION_IN_MENU 1
 #if START_APPLICATION_IN_MENU
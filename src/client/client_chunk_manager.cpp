@@ -11,12 +11,17 @@ using namespace std;
 
 static logging::Logger logger("ccm");
 
+// archive operations handled together, the loads among them are read in
+// batches
+static const size_t MAX_ARCHIVE_BATCH = 256;
+
 ClientChunkManager::ClientChunkManager(Client *client, std::unique_ptr<ChunkArchive> archive) :
 	threadOutQueue(1024),
 	threadInQueue(1024),
 	chunks(0, vec3i64HashFunc),
 	cachedRevisions(0, vec3i64HashFunc),
 	needCounter(0, vec3i64HashFunc),
+	pendingPatches(0, vec3i64HashFunc),
 	client(client),
 	archive(std::move(archive))
 {
@@ -33,20 +38,23 @@ ClientChunkManager::~ClientChunkManager() {
 	ArchiveOperation op;
 	while(threadOutQueue.pop(op));
 	wait();
+	// everything is journaled with a single write
+	std::vector<const Chunk *> stored;
 	while (!preThreadInQueue.empty()) {
 		ArchiveOperation op = preThreadInQueue.front();
 		preThreadInQueue.pop();
 		if (op.type != STORE)
 			continue;
-		archive->storeChunk(*op.chunk);
+		stored.push_back(op.chunk);
 	}
 	for (auto it1 = chunks.begin(); it1 != chunks.end(); ++it1) {
 		Chunk *chunk = it1->second;
 		uint32 revision;
 		bool cached = archive->hasChunk(chunk->getCC(), &revision);
 		if (!cached || revision != chunk->getRevision())
-			archive->storeChunk(*chunk);
+			stored.push_back(chunk);
 	}
+	archive->storeChunks(stored);
 	for (int i = 0; i < CHUNK_POOL_SIZE; i++) {
 		delete chunkPool[i];
 	}
@@ -77,6 +85,9 @@ void ClientChunkManager::tick() {
 			insertReceivedChunk(chunk);
 			numSessionChunkGens++;
 		} else {
+			ChunkPatch patch;
+			if (client->getServerInterface()->getChunkPatch(chunk->getCC(), &patch))
+				pendingPatches[chunk->getCC()] = std::move(patch);
 			ArchiveOperation op = {chunk, LOAD};
 			preThreadInQueue.push(op);
 		}
@@ -95,7 +106,9 @@ void ClientChunkManager::tick() {
 	while (threadOutQueue.pop(op)) {
 		switch(op.type) {
 		case LOAD:
-			if (op.chunk->isInitialized()) {
+			if (pendingPatches.find(op.chunk->getCC()) != pendingPatches.end()) {
+				applyPatch(op.chunk);
+			} else if (op.chunk->isInitialized()) {
 				insertLoadedChunk(op.chunk);
 				numSessionChunkLoads++;
 			} else {
@@ -113,34 +126,46 @@ void ClientChunkManager::tick() {
 }
 
 void ClientChunkManager::doWork() {
+	std::vector<ArchiveOperation> ops;
 	ArchiveOperation op;
-	if (threadInQueue.pop(op)) {
-		switch (op.type) {
-		case LOAD:
-			archive->loadChunk(op.chunk);
-			break;
-		case STORE:
-			archive->storeChunk(*op.chunk);
-			break;
-		case STORE_SILENTLY:
-			archive->storeChunk(*op.chunk);
-			break;
-		}
+	while (ops.size() < MAX_ARCHIVE_BATCH && threadInQueue.pop(op))
+		ops.push_back(op);
+
+	if (ops.empty()) {
+		sleepFor(millis(100));
+		return;
+	}
+
+	// a chunk is only loaded again after it was stored, so the stores
+	// can go first
+	std::vector<const Chunk *> stored;
+	std::vector<Chunk *> loaded;
+	for (const ArchiveOperation &op : ops) {
+		if (op.type == LOAD)
+			loaded.push_back(op.chunk);
+		else
+			stored.push_back(op.chunk);
+	}
+	if (!stored.empty())
+		archive->storeChunks(stored);
+	if (!loaded.empty())
+		archive->loadChunks(loaded, &ring);
+
+	for (const ArchiveOperation &op : ops) {
 		while (op.type != STORE_SILENTLY && !threadOutQueue.push(op)) {
 			sleepFor(millis(50));
 		}
-	} else {
-		sleepFor(millis(100));
 	}
 }
 
 void ClientChunkManager::onStop() {
+	std::vector<const Chunk *> stored;
 	ArchiveOperation op;
 	while (threadInQueue.pop(op)) {
-		if (op.type == STORE) {
-			archive->storeChunk(*op.chunk);
-		}
+		if (op.type == STORE)
+			stored.push_back(op.chunk);
 	}
+	archive->storeChunks(stored);
 }
 
 void ClientChunkManager::placeBlock(vec3i64 chunkCoords, size_t intraChunkIndex,
@@ -149,6 +174,12 @@ void ClientChunkManager::placeBlock(vec3i64 chunkCoords, size_t intraChunkIndex,
 	if (it != chunks.end()) {
 		if (it->second->getRevision() == revision) {
 			it->second->setBlock(intraChunkIndex, blockType);
+			vec3i64 dropped;
+			if (editedChunks.touch(chunkCoords, &dropped)) {
+				auto it2 = chunks.find(dropped);
+				if (it2 != chunks.end())
+					it2->second->releaseConnectivity();
+			}
 		} else {
 			LOG_WARNING(logger) << "Couldn't apply chunk patch";
 		}
@@ -235,6 +266,30 @@ void ClientChunkManager::insertReceivedChunk(Chunk *chunk) {
 	}
 }
 
+void ClientChunkManager::applyPatch(Chunk *chunk) {
+	auto it = pendingPatches.find(chunk->getCC());
+	ChunkPatch patch = std::move(it->second);
+	pendingPatches.erase(it);
+
+	if (!chunk->isInitialized() || chunk->getRevision() != patch.baseRevision) {
+		// our copy isn't what the server based the patch on
+		LOG_WARNING(logger) << "Couldn't apply chunk patch, requesting whole chunk";
+		vec3i64 cc = chunk->getCC();
+		chunk->reset();
+		chunk->initCC(cc);
+		client->getServerInterface()->requestChunk(chunk, false, 0);
+		return;
+	}
+
+	for (const ChunkEdit &edit : patch.edits)
+		chunk->setBlock(edit.index, edit.type);
+	// patches come in one piece, there is no next edit to prepare for
+	chunk->releaseConnectivity();
+	chunk->initRevision(patch.revision);
+	insertReceivedChunk(chunk);
+	numSessionChunkLoads++;
+}
+
 void ClientChunkManager::recycleChunk(Chunk *chunk) {
 	chunk->reset();
 	unusedChunks.push(chunk);
@@ -11,10 +11,12 @@
 
 #include "shared/engine/vmath.hpp"
 #include "shared/engine/queue.hpp"
+#include "shared/engine/io_ring.hpp"
 #include "shared/engine/thread.hpp"
 #include "shared/game/chunk.hpp"
 #include "shared/block_utils.hpp"
 #include "shared/chunk_archive.hpp"
+#include "client/server_interface.hpp"
 
 class Client;
 
@@ -45,6 +47,8 @@ private:
 	std::unordered_map<vec3i64, Chunk *, size_t(*)(vec3i64)> chunks;
 	std::unordered_map<vec3i64, uint32, size_t(*)(vec3i64)> cachedRevisions;
 	std::unordered_map<vec3i64, int, size_t(*)(vec3i64)> needCounter;
+	std::unordered_map<vec3i64, ChunkPatch, size_t(*)(vec3i64)> pendingPatches;
+	RecentlyEditedChunks editedChunks;
 
 	int numSessionChunkLoads = 0;
 	int numSessionChunkGens = 0;
@@ -52,6 +56,8 @@ private:
 	Client *client = nullptr;
 
 	std::unique_ptr<ChunkArchive> archive;
+	// only used by the archive thread
+	IORing ring;
 
 public:
 	ClientChunkManager(Client *client, std::unique_ptr<ChunkArchive> archive);
@@ -81,6 +87,7 @@ public:
 private:
 	void insertLoadedChunk(Chunk *chunk);
 	void insertReceivedChunk(Chunk *chunk);
+	void applyPatch(Chunk *chunk);
 	void recycleChunk(Chunk *chunk);
 };
 
@@ -241,14 +241,46 @@ ChunkRenderer::ChunkVisuals ChunkRenderer::buildChunk(ChunkArea area) {
 	std::vector<Quad> quads;
 	quads.reserve(Chunk::WIDTH * Chunk::WIDTH * (Chunk::WIDTH + 1) * 3);
 
-	const uint8 *blocks = chunk.getBlocks();
+	uint8 blocks[Chunk::SIZE];
+	chunk.getBlocks(blocks);
 	for (uint8 d = 0; d < 3; d++) {
 		vec3i64 dir = DIRS[d].cast<int64>();
 		uint dimFlipIndexDiff = (uint) (((dir[2] * Chunk::WIDTH + dir[1]) * Chunk::WIDTH + dir[0]) * (Chunk::WIDTH - 1));
+		const Chunk &prevChunk = *area.chunks[DIR_TO_BIG_CUBE_CYCLE_INDEX[d + 3]];
+		const Chunk &nextChunk = *area.chunks[DIR_TO_BIG_CUBE_CYCLE_INDEX[d]];
 		uint i = 0;
 		uint ni = 0;
 		for (int z = (d == 2) ? -1 : 0; z < (int) Chunk::WIDTH; z++) {
 			for (int y = (d == 1) ? -1 : 0; y < (int) Chunk::WIDTH; y++) {
+				// skip rows without a single change between air and solid
+				bool rowOutside = y == -1 || z == -1;
+				bool nextRowOutside = (y == Chunk::WIDTH - 1 && d == 1)
+						|| (z == Chunk::WIDTH - 1 && d == 2);
+				uint32 faces;
+				if (d == 0) {
+					uint32 row = chunk.getSolidRow(y, z);
+					uint32 prev = prevChunk.getSolidRow(y, z) >> (Chunk::WIDTH - 1);
+					uint32 next = nextChunk.getSolidRow(y, z) << (Chunk::WIDTH - 1);
+					faces = (row ^ ((row >> 1) | next)) | ((prev ^ row) & 1);
+				} else {
+					int ny = y + (d == 1);
+					int nz = z + (d == 2);
+					uint32 row = rowOutside
+							? prevChunk.getSolidRow(y & (Chunk::WIDTH - 1), z & (Chunk::WIDTH - 1))
+							: chunk.getSolidRow(y, z);
+					uint32 nextRow = nextRowOutside
+							? nextChunk.getSolidRow(ny & (Chunk::WIDTH - 1), nz & (Chunk::WIDTH - 1))
+							: chunk.getSolidRow(ny, nz);
+					faces = row ^ nextRow;
+				}
+				if (faces == 0) {
+					if (!rowOutside)
+						i += Chunk::WIDTH;
+					if (!nextRowOutside)
+						ni += Chunk::WIDTH;
+					continue;
+				}
+
 				for (int x = (d == 0) ? -1 : 0; x < (int) Chunk::WIDTH; x++) {
 					uint8 thatType;
 					uint8 thisType;
@@ -259,7 +291,7 @@ ChunkRenderer::ChunkVisuals ChunkRenderer::buildChunk(ChunkArea area) {
 							|| (z == Chunk::WIDTH - 1 && d==2));
 					if (thatOutside) {
 						const Chunk &otherChunk = *area.chunks[DIR_TO_BIG_CUBE_CYCLE_INDEX[d]];
-						thatType = otherChunk.getBlocks()[i - dimFlipIndexDiff];
+						thatType = otherChunk.getBlock(i - dimFlipIndexDiff);
 						if (thatType != 0) {
 							if (!thisOutside)
 								i++;
@@ -270,7 +302,7 @@ ChunkRenderer::ChunkVisuals ChunkRenderer::buildChunk(ChunkArea area) {
 
 					if (thisOutside) {
 						const Chunk &otherChunk = *area.chunks[DIR_TO_BIG_CUBE_CYCLE_INDEX[d + 3]];
-						thisType = otherChunk.getBlocks()[ni - 1 + dimFlipIndexDiff];
+						thisType = otherChunk.getBlock(ni - 1 + dimFlipIndexDiff);
 						if (thisType != 0)
 							continue;
 					} else {
@@ -16,9 +16,11 @@ static logging::Logger logger("remote");
 RemoteServerInterface::RemoteServerInterface(Client *client, std::string addressString) :
 		client(client),
 		requestedChunks(0, vec3i64HashFunc),
+		chunkPatches(0, vec3i64HashFunc),
 		worldGenerator(new WorldGenerator(42, WorldParams())),
 		asyncWorldGenerator(worldGenerator.get()),
-		encodedBuffer(new uint8[Chunk::SIZE * MAX_CHUNKS_PER_MESSAGE])
+		encodedBuffer(new uint8[Chunk::SIZE * MAX_CHUNKS_PER_MESSAGE]),
+		editBuffer(MAX_EDITS_PER_CHUNK_DELTA * MAX_CHUNKS_PER_MESSAGE)
 {
 	if (enet_initialize() != 0) {
 		LOG_FATAL(logger) << "An error occurred while initializing ENet.";
@@ -194,6 +196,15 @@ Chunk *RemoteServerInterface::getNextChunk() {
 	return chunk;
 }
 
+bool RemoteServerInterface::getChunkPatch(vec3i64 chunkCoords, ChunkPatch *patch) {
+	auto it = chunkPatches.find(chunkCoords);
+	if (it == chunkPatches.end())
+		return false;
+	*patch = std::move(it->second);
+	chunkPatches.erase(it);
+	return true;
+}
+
 void RemoteServerInterface::updateNet() {
 	ENetEvent event;
 	while (enet_host_service(host, &event, 0) > 0) {
@@ -347,7 +358,9 @@ void RemoteServerInterface::handlePacket(const enet_uint8 *data, size_t size, si
 						LOG_WARNING(logger) << "Chunk message is missing block data";
 						break;
 					}
-					decodeBlocks_RLE(eb, cmd.encodedLength, chunk->getBlocksForInit());
+					uint8 blocks[Chunk::SIZE];
+					decodeBlocks_RLE(eb, cmd.encodedLength, blocks);
+					chunk->initBlocks(blocks);
 					eb += cmd.encodedLength;
 					chunk->initRevision(cmd.revision);
 					chunk->finishInitialization();
@@ -357,6 +370,36 @@ void RemoteServerInterface::handlePacket(const enet_uint8 *data, size_t size, si
 			}
 		}
 		break;
+	case CHUNK_DELTA_MESSAGE:
+		{
+			ChunkDeltaMessage msg;
+			msg.edits = editBuffer.data();
+			if (readMessageBody((const char *) data, size, &msg)) {
+				LOG_WARNING(logger) << "Received malformed message";
+				break;
+			}
+			const ChunkEdit *edits = editBuffer.data();
+			for (uint i = 0; i < msg.numChunks; i++) {
+				const ChunkDeltaData &cdd = msg.chunkDeltaData[i];
+				vec3i64 coords = chunkMessageAnchor + cdd.relCoords;
+				auto it = requestedChunks.find(coords);
+				if (it == requestedChunks.end())
+					break;
+				if (!it->second.cached) {
+					LOG_WARNING(logger) << "Received chunk delta for uncached chunk";
+					break;
+				}
+				// the chunk is loaded from the archive and patched there
+				ChunkPatch &patch = chunkPatches[coords];
+				patch.baseRevision = it->second.cachedRevision;
+				patch.revision = cdd.revision;
+				patch.edits.assign(edits, edits + cdd.numEdits);
+				edits += cdd.numEdits;
+				receivedChunks.push(it->second.chunk);
+				requestedChunks.erase(it);
+			}
+		}
+		break;
 	case CHUNK_ANCHOR_SET:
 		{
 			ChunkAnchorSet msg;
@@ -34,6 +34,7 @@ private:
 	std::unordered_map<vec3i64, RequestedChunk, size_t(*)(vec3i64)> requestedChunks;
 	std::queue<RequestedChunk> toRequestQueue;
 	std::queue<Chunk *> receivedChunks;
+	std::unordered_map<vec3i64, ChunkPatch, size_t(*)(vec3i64)> chunkPatches;
 
 	std::unique_ptr<WorldGenerator> worldGenerator;
 	AsyncWorldGenerator asyncWorldGenerator;
@@ -41,6 +42,7 @@ private:
 	Status status = NOT_CONNECTED;
 
 	std::unique_ptr<uint8> encodedBuffer; // TODO make this obsolete
+	std::vector<ChunkEdit> editBuffer;
 
 	ENetHost *host = nullptr;
 	ENetPeer *peer = nullptr;
@@ -73,6 +75,7 @@ public:
 
 	void requestChunk(Chunk *chunk, bool cached, uint32 cachedRevision) override;
 	Chunk *getNextChunk() override;
+	bool getChunkPatch(vec3i64 chunkCoords, ChunkPatch *patch) override;
 
 private:
 	void updateNet();
@@ -1,13 +1,24 @@
 #ifndef SERVER_INTERFACE_HPP
 #define SERVER_INTERFACE_HPP
 
+#include <vector>
+
 #include "shared/engine/vmath.hpp"
 #include "shared/engine/queue.hpp"
 #include "shared/engine/thread.hpp"
 #include "shared/game/chunk.hpp"
+#include "shared/net.hpp"
 
 #include "config.hpp"
 
+// edits the server sent for a chunk instead of the whole chunk, to be
+// applied on top of the cached copy at baseRevision
+struct ChunkPatch {
+	uint32 baseRevision;
+	uint32 revision;
+	std::vector<ChunkEdit> edits;
+};
+
 class ServerInterface {
 public:
 	enum Status {
@@ -42,6 +53,8 @@ public:
 	// chunks
 	virtual void requestChunk(Chunk *chunk, bool cached, uint32 cachedRevision) = 0;
 	virtual Chunk *getNextChunk() = 0;
+	// for chunks getNextChunk returned uninitialized
+	virtual bool getChunkPatch(vec3i64, ChunkPatch *) { return false; }
 };
 
 #endif // SERVER_INTERFACE_HPP
@@ -3,12 +3,15 @@
 #include <boost/filesystem.hpp>
 
 #include "shared/saves.hpp"
+#include "shared/engine/logging.hpp"
 #include "shared/engine/random.hpp"
 
 #include "client/client.hpp"
 #include "client/client_chunk_manager.hpp"
 #include "client/local_server_interface.hpp"
 
+static logging::Logger logger("client");
+
 void LocalPlayingState::init(std::string world_id) {
 	_world_id = world_id;
 }
@@ -26,6 +29,13 @@ void LocalPlayingState::onPush(State *old_top) {
 		client->save->initialize(_world_id, seed);
 		client->save->store();
 	}
+	// a second process would write to the same journal and regions
+	if (!client->save->lock()) {
+		LOG_ERROR(logger) << "World '" << _world_id << "' is used by another process";
+		client->save.reset();
+		client->closeRequested = true;
+		return;
+	}
 
 	ClientChunkManager *cm = new ClientChunkManager(client, client->save->getChunkArchive());
 	client->chunkManager = std::unique_ptr<ClientChunkManager>(cm);
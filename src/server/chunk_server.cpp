@@ -1,11 +1,14 @@
 #include "chunk_server.hpp"
 
+#include <algorithm>
+
 #include "shared/chunk_compression.hpp"
 
 static logging::Logger logger("cserver");
 
 ChunkServer::ChunkServer(Server *server) : server(server),
-		encodedBuffer(new uint8[Chunk::SIZE * MAX_CHUNKS_PER_MESSAGE])
+		encodedBuffer(new uint8[Chunk::SIZE * MAX_CHUNKS_PER_MESSAGE]),
+		editBuffer(MAX_EDITS_PER_CHUNK_DELTA * MAX_CHUNKS_PER_MESSAGE)
 {
 	LOG_INFO(logger) << "Creating chunk server";
 	chunkManager = server->getChunkManager();
@@ -25,6 +28,11 @@ void ChunkServer::tick() {
 		uint msgChunks = 0;
 		msg.encodedBuffer = encodedBuffer.get();
 		uint8 *eb = encodedBuffer.get();
+		// chunks the client has an older revision of get only the edits
+		ChunkDeltaMessage deltaMsg;
+		uint deltaChunks = 0;
+		deltaMsg.edits = editBuffer.data();
+		ChunkEdit *edits = editBuffer.data();
 		while(!requestedQueue[i].empty()) {
 			SingleChunkRequest scr = requestedQueue[i].front();
 			const Chunk *chunk = chunkManager->getChunk(scr.coords);
@@ -40,22 +48,43 @@ void ChunkServer::tick() {
 					break;
 				}
 			}
+			bool sendDelta = scr.cached && chunk->getRevision() != scr.cachedRevision
+					&& chunkManager->getChunkEdits(scr.coords, scr.cachedRevision, &chunkEdits);
 			if ((!smallEnough && msgChunks > 0) || msgChunks >= MAX_CHUNKS_PER_REQUEST) {
 				msg.numChunks = msgChunks;
 				server->send(msg, i, CHANNEL_BLOCK_DATA, true);
 				eb = encodedBuffer.get();
 				msgChunks = 0;
 			}
+			if ((!smallEnough && deltaChunks > 0) || deltaChunks >= MAX_CHUNKS_PER_MESSAGE) {
+				deltaMsg.numChunks = deltaChunks;
+				server->send(deltaMsg, i, CHANNEL_BLOCK_DATA, true);
+				edits = editBuffer.data();
+				deltaChunks = 0;
+			}
 			if (!smallEnough) {
 				ChunkAnchorSet anchorSet;
 				anchorSet.coords = scr.coords;
 				server->send(anchorSet, i, CHANNEL_BLOCK_DATA, true);
 				messageAnchors[i] = scr.coords;
 			}
+			if (sendDelta) {
+				ChunkDeltaData &cdd = deltaMsg.chunkDeltaData[deltaChunks];
+				cdd.relCoords = scr.coords - messageAnchors[i];
+				cdd.revision = chunk->getRevision();
+				cdd.numEdits = (uint) chunkEdits.size();
+				std::copy(chunkEdits.begin(), chunkEdits.end(), edits);
+				edits += chunkEdits.size();
+				deltaChunks++;
+				chunkManager->releaseChunk(scr.coords);
+				continue;
+			}
 			msg.chunkMessageData[msgChunks].relCoords = scr.coords - messageAnchors[i];
 			msg.chunkMessageData[msgChunks].revision = chunk->getRevision();
 			if (!scr.cached || chunk->getRevision() != scr.cachedRevision) {
-				size_t el = encodeBlocks_RLE(chunk->getBlocks(), eb, Chunk::SIZE);
+				uint8 blocks[Chunk::SIZE];
+				chunk->getBlocks(blocks);
+				size_t el = encodeBlocks_RLE(blocks, eb, Chunk::SIZE);
 				msg.chunkMessageData[msgChunks].encodedLength = el;
 				eb += el;
 			} else {
@@ -68,6 +97,10 @@ void ChunkServer::tick() {
 			msg.numChunks = msgChunks;
 			server->send(msg, i, CHANNEL_BLOCK_DATA, true);
 		}
+		if (deltaChunks > 0) {
+			deltaMsg.numChunks = deltaChunks;
+			server->send(deltaMsg, i, CHANNEL_BLOCK_DATA, true);
+		}
 	}
 }
 
@@ -2,6 +2,7 @@
 #define CHUNK_SERVER_HPP
 
 #include <deque>
+#include <vector>
 
 #include "server.hpp"
 
@@ -21,6 +22,8 @@ private:
 	vec3i64 messageAnchors[MAX_CLIENTS];
 
 	std::unique_ptr<uint8> encodedBuffer; // TODO make this obsolete
+	std::vector<ChunkEdit> editBuffer;
+	std::vector<ChunkEdit> chunkEdits;
 
 public:
 	ChunkServer(Server *server);
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <csignal>
+#include <stdexcept>
 #include <boost/filesystem.hpp>
 
 #include "shared/engine/std_types.hpp"
@@ -31,9 +32,9 @@ int main() {
 	LOG_TRACE(logger) << "Trace enabled";
 
 	initUtil();
-	Server server(8547);
 
 	try {
+		Server server(8547);
 		server.run();
 	} catch (std::exception &e) {
 		LOG_FATAL(logger) << "Exception: " << e.what();
@@ -54,8 +55,12 @@ Server::Server(uint16 port, const char *worldId) {
 		save->initialize(worldId, seed);
 		save->store();
 	}
+	// a second process would write to the same journal and regions
+	if (!save->lock())
+		throw std::runtime_error(std::string("World '") + worldId + "' is used by another process");
 
-	ServerChunkManager *cm = new ServerChunkManager(save->getWorldGenerator(), save->getChunkArchive());
+	ServerChunkManager *cm = new ServerChunkManager(save->getWorldGenerator(), save->getChunkArchive(),
+			save->getArchiveWorkers());
 	chunkManager = std::unique_ptr<ServerChunkManager>(cm);
 	world = std::unique_ptr<World>(new World(chunkManager.get()));
 
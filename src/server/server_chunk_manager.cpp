@@ -1,5 +1,7 @@
 #include "server_chunk_manager.hpp"
 
+#include <algorithm>
+
 #include "shared/engine/logging.hpp"
 #include "shared/engine/time.hpp"
 #include "shared/game/world.hpp"
@@ -8,52 +10,168 @@ using namespace std;
 
 static logging::Logger logger("chm");
 
+// every now and then the maintenance thread compacts the most fragmented
+// region that wasn't used for a while
+static const float COMPACTION_MIN_FRAGMENTATION = 0.25f;
+static const Time COMPACTION_INTERVAL = seconds(60);
+static const Time COMPACTION_MIN_IDLE = seconds(30);
+// journaled chunks are written to their regions when there is time
+static const Time CHECKPOINT_INTERVAL = seconds(10);
+// region files are closed after they weren't used for this long
+static const Time REGION_IDLE_TIME = seconds(30);
+// archive operations handled together by a worker, all stores among
+// them are committed with a single write
+static const size_t MAX_ARCHIVE_BATCH = 256;
+
+class ServerChunkManager::ArchiveWorker : public Thread {
+public:
+	ArchiveWorker(ChunkArchive *archive) :
+		Thread("archive worker"),
+		inQueue(1024),
+		outQueue(1024),
+		archive(archive)
+	{
+		dispatch();
+	}
+
+	// only the chunk manager's thread pushes and pops
+	ProducerQueue<ArchiveOperation> inQueue;
+	ProducerQueue<ArchiveOperation> outQueue;
+
+	bool isAsync() const { return ring.isAsync(); }
+
+	virtual void doWork() override;
+	virtual void onStop() override;
+
+private:
+	ChunkArchive *archive;
+	IORing ring;
+};
+
+void ServerChunkManager::ArchiveWorker::doWork() {
+	std::vector<ArchiveOperation> ops;
+	ArchiveOperation op;
+	while (ops.size() < MAX_ARCHIVE_BATCH && inQueue.pop(op))
+		ops.push_back(op);
+
+	if (ops.empty()) {
+		sleepFor(millis(10));
+		return;
+	}
+
+	// a chunk is only loaded again after it was stored, so the stores
+	// can go first
+	std::vector<const Chunk *> stored;
+	for (const ArchiveOperation &op : ops) {
+		if (op.type == STORE)
+			stored.push_back(op.chunk);
+	}
+	if (!stored.empty())
+		archive->storeChunks(stored);
+	std::vector<Chunk *> loaded;
+	for (const ArchiveOperation &op : ops) {
+		if (op.type == LOAD)
+			loaded.push_back(op.chunk);
+	}
+	if (!loaded.empty())
+		archive->loadChunks(loaded, &ring);
+
+	for (const ArchiveOperation &op : ops) {
+		while (!outQueue.push(op)) {
+			// nobody takes the results anymore
+			if (isTerminationRequested())
+				return;
+			sleepFor(millis(50));
+		}
+	}
+}
+
+void ServerChunkManager::ArchiveWorker::onStop() {
+	std::vector<const Chunk *> stored;
+	ArchiveOperation op;
+	while (inQueue.pop(op)) {
+		if (op.type == STORE)
+			stored.push_back(op.chunk);
+	}
+	archive->storeChunks(stored);
+}
+
 ServerChunkManager::ServerChunkManager(
 		std::unique_ptr<WorldGenerator> worldGenerator,
-		std::unique_ptr<ChunkArchive> archive) :
-	threadOutQueue(1024),
-	threadInQueue(1024),
+		std::unique_ptr<ChunkArchive> archive, int numArchiveWorkers) :
 	chunks(0, vec3i64HashFunc),
 	cacheRevisions(0, vec3i64HashFunc),
 	needCounter(0, vec3i64HashFunc),
+	journals(0, vec3i64HashFunc),
+	releasedChunks(CHUNK_CACHE_SIZE),
 	worldGenerator(std::move(worldGenerator)),
 	asyncWorldGenerator(this->worldGenerator.get()),
-	archive(std::move(archive))
+	archive(std::move(archive)),
+	nextCompaction(getCurrentTime() + COMPACTION_INTERVAL),
+	nextCheckpoint(getCurrentTime() + CHECKPOINT_INTERVAL)
 {
 	for (int i = 0; i < CHUNK_POOL_SIZE; i++) {
 		chunkPool[i] = new Chunk(Chunk::ChunkFlags::VISUAL);
 		unusedChunks.push(chunkPool[i]);
 	}
+	// with an io_uring a single worker keeps plenty of requests in
+	// flight, without one the reads block, so more workers help
+	archiveWorkers.emplace_back(new ArchiveWorker(this->archive.get()));
+	if (archiveWorkers[0]->isAsync()) {
+		LOG_INFO(logger) << "Using one archive worker with io_uring";
+	} else {
+		for (int i = 1; i < numArchiveWorkers; i++)
+			archiveWorkers.emplace_back(new ArchiveWorker(this->archive.get()));
+	}
 	dispatch();
 }
 
 ServerChunkManager::~ServerChunkManager() {
 	LOG_TRACE(logger) << "Destroying ChunkManager";
-	requestTermination();
-	ArchiveOperation op;
-	while(threadOutQueue.pop(op));
+	for (auto &worker : archiveWorkers)
+		worker->requestTermination();
+	for (auto &worker : archiveWorkers)
+		worker->wait();
+	archiveWorkers.clear();
 	wait();
+	std::vector<const Chunk *> stored;
 	while (!prethreadInQueue.empty()) {
 		ArchiveOperation op = prethreadInQueue.front();
 		prethreadInQueue.pop();
 		if (op.type != STORE)
 			continue;
-		archive->storeChunk(*op.chunk);
+		stored.push_back(op.chunk);
 	}
 	for (auto it1 = chunks.begin(); it1 != chunks.end(); ++it1) {
 		auto it2 = cacheRevisions.find(it1->first);
 		if (it2 == cacheRevisions.end() || it1->second->getRevision() != it2->second)
-			archive->storeChunk(*it1->second);
+			stored.push_back(it1->second);
 	}
+	archive->storeChunks(stored);
 	for (int i = 0; i < CHUNK_POOL_SIZE; i++) {
 		delete chunkPool[i];
 	}
 }
 
 void ServerChunkManager::tick() {
-	while (!requestedQueue.empty() && !unusedChunks.empty()) {
+	while (!requestedQueue.empty()) {
 		vec3i64 cc = requestedQueue.front();
-		Chunk *chunk = unusedChunks.top();
+		Chunk *chunk = releasedChunks.take(cc);
+		if (chunk) {
+			insertLoadedChunk(chunk);
+			requestedQueue.pop();
+			numSessionCacheHits++;
+			continue;
+		}
+
+		// cached chunks make room for the ones that are needed
+		if (unusedChunks.empty()) {
+			Chunk *evicted = releasedChunks.evict();
+			if (!evicted)
+				break;
+			recycleChunk(evicted);
+		}
+		chunk = unusedChunks.top();
 		if (!chunk)
 			LOG_ERROR(logger) << "Chunk allocation failed";
 		chunk->initCC(cc);
@@ -65,7 +183,8 @@ void ServerChunkManager::tick() {
 
 	while (!prethreadInQueue.empty()) {
 		ArchiveOperation op = prethreadInQueue.front();
-		if (!threadInQueue.push(op))
+		size_t worker = vec3i64HashFunc(op.chunk->getCC()) % archiveWorkers.size();
+		if (!archiveWorkers[worker]->inQueue.push(op))
 			break;
 		prethreadInQueue.pop();
 	}
@@ -77,19 +196,21 @@ void ServerChunkManager::tick() {
 		toGenerateQueue.pop();
 	}
 
-	ArchiveOperation op;
-	while (threadOutQueue.pop(op)) {
-		switch(op.type) {
-		case LOAD:
-			if (op.chunk->isInitialized())
-				insertLoadedChunk(op.chunk);
-			else
-				toGenerateQueue.push(op.chunk);
-			numSessionChunkLoads++;
-			break;
-		case STORE:
-			recycleChunk(op.chunk);
-			break;
+	for (auto &worker : archiveWorkers) {
+		ArchiveOperation op;
+		while (worker->outQueue.pop(op)) {
+			switch(op.type) {
+			case LOAD:
+				if (op.chunk->isInitialized())
+					insertLoadedChunk(op.chunk);
+				else
+					toGenerateQueue.push(op.chunk);
+				numSessionChunkLoads++;
+				break;
+			case STORE:
+				cacheChunk(op.chunk);
+				break;
+			}
 		}
 	}
 
@@ -103,45 +224,69 @@ void ServerChunkManager::tick() {
 }
 
 void ServerChunkManager::doWork() {
-	ArchiveOperation op;
-	if (threadInQueue.pop(op)) {
-		switch (op.type) {
-		case LOAD:
-			archive->loadChunk(op.chunk);
-			break;
-		case STORE:
-			archive->storeChunk(*op.chunk);
-			break;
-		}
-		while (!threadOutQueue.push(op)) {
-			sleepFor(millis(50));
-		}
-	} else {
-		sleepFor(millis(100));
+	Time now = getCurrentTime();
+	if (now >= nextCheckpoint) {
+		archive->checkpoint();
+		archive->clean(REGION_IDLE_TIME);
+		nextCheckpoint = now + CHECKPOINT_INTERVAL;
 	}
-}
-
-void ServerChunkManager::onStop() {
-	ArchiveOperation op;
-	while (threadInQueue.pop(op)) {
-		if (op.type == STORE) {
-			archive->storeChunk(*op.chunk);
-		}
+	if (now >= nextCompaction) {
+		archive->compactRegions(COMPACTION_MIN_FRAGMENTATION, 1, COMPACTION_MIN_IDLE);
+		nextCompaction = now + COMPACTION_INTERVAL;
 	}
+	sleepFor(millis(100));
 }
 
 void ServerChunkManager::placeBlock(vec3i64 chunkCoords, size_t intraChunkIndex,
 		uint blockType, uint32 revision) {
 	auto it = chunks.find(chunkCoords);
 	if (it != chunks.end()) {
-		if (it->second->getRevision() == revision)
+		if (it->second->getRevision() == revision) {
 			it->second->setBlock(intraChunkIndex, blockType);
-		else
+			if (it->second->getRevision() != revision)
+				recordEdit(chunkCoords, revision, intraChunkIndex, blockType);
+			vec3i64 dropped;
+			if (editedChunks.touch(chunkCoords, &dropped)) {
+				auto it2 = chunks.find(dropped);
+				if (it2 != chunks.end())
+					it2->second->releaseConnectivity();
+			}
+		} else
 			LOG_WARNING(logger) << "couldn't apply chunk patch";
 	}
 	// TODO operate on cache if chunk is not loaded
 }
 
+bool ServerChunkManager::getChunkEdits(vec3i64 chunkCoords, uint32 sinceRevision,
+		std::vector<ChunkEdit> *edits) const {
+	auto it = journals.find(chunkCoords);
+	if (it == journals.end())
+		return false;
+	const ChunkJournal &journal = it->second;
+	const uint32 revision = journal.baseRevision + (uint32) journal.edits.size();
+	const Chunk *chunk = getChunk(chunkCoords);
+	if (!chunk || chunk->getRevision() != revision
+			|| sinceRevision < journal.baseRevision || sinceRevision >= revision)
+		return false;
+
+	edits->clear();
+	for (auto edit = journal.edits.rbegin(); edit != journal.edits.rend(); ++edit) {
+		if (edit->revision <= sinceRevision)
+			break;
+		bool overwritten = false;
+		for (const ChunkEdit &later : *edits) {
+			if (later.index == edit->index) {
+				overwritten = true;
+				break;
+			}
+		}
+		if (!overwritten)
+			edits->push_back(*edit);
+	}
+	std::reverse(edits->begin(), edits->end());
+	return true;
+}
+
 const Chunk *ServerChunkManager::getChunk(vec3i64 chunkCoords) const {
 	auto it = chunks.find(chunkCoords);
 	if (it != chunks.end())
@@ -171,10 +316,12 @@ void ServerChunkManager::releaseChunk(vec3i64 chunkCoords) {
 				if (it3 == cacheRevisions.end() || it2->second->getRevision() != it3->second)
 					prethreadInQueue.push(ArchiveOperation{it2->second, STORE});
 				else
-					recycleChunk(it2->second);
+					cacheChunk(it2->second);
 				chunks.erase(it2);
 				if (it3 != cacheRevisions.end())
 					cacheRevisions.erase(it3);
+				// edits are only handed out for loaded chunks
+				journals.erase(chunkCoords);
 			}
 		}
 	}
@@ -206,7 +353,7 @@ void ServerChunkManager::insertLoadedChunk(Chunk *chunk) {
 		chunks.insert({chunk->getCC(), chunk});
 		cacheRevisions.insert({chunk->getCC(), chunk->getRevision()});
 	} else {
-		recycleChunk(chunk);
+		cacheChunk(chunk);
 	}
 }
 
@@ -220,6 +367,35 @@ void ServerChunkManager::insertReceivedChunk(Chunk *chunk) {
 	}
 }
 
+void ServerChunkManager::recordEdit(vec3i64 chunkCoords, uint32 oldRevision,
+		size_t index, uint8 type) {
+	auto it = journals.find(chunkCoords);
+	if (it == journals.end())
+		it = journals.insert({chunkCoords, ChunkJournal{oldRevision, {}}}).first;
+	ChunkJournal &journal = it->second;
+	if (journal.baseRevision + journal.edits.size() != oldRevision) {
+		// the chunk changed without us noticing, start over
+		journal.baseRevision = oldRevision;
+		journal.edits.clear();
+	}
+	journal.edits.push_back(ChunkEdit{oldRevision + 1, (uint16) index, type});
+	if (journal.edits.size() > MAX_JOURNAL_LENGTH) {
+		journal.edits.pop_front();
+		journal.baseRevision++;
+	}
+}
+
+void ServerChunkManager::cacheChunk(Chunk *chunk) {
+	// a needed chunk might still change, a cached copy would go stale
+	if (needCounter.find(chunk->getCC()) != needCounter.end()) {
+		recycleChunk(chunk);
+		return;
+	}
+	Chunk *displaced = releasedChunks.insert(chunk);
+	if (displaced)
+		recycleChunk(displaced);
+}
+
 void ServerChunkManager::recycleChunk(Chunk *chunk) {
 	chunk->reset();
 	unusedChunks.push(chunk);
@@ -3,24 +3,31 @@
 
 #include <memory>
 #include <atomic>
+#include <deque>
 #include <future>
 #include <queue>
 #include <stack>
+#include <vector>
 
 #include "shared/chunk_manager.hpp"
 
 #include "shared/engine/vmath.hpp"
 #include "shared/engine/queue.hpp"
+#include "shared/engine/io_ring.hpp"
 #include "shared/engine/thread.hpp"
 #include "shared/game/chunk.hpp"
 #include "shared/game/world_generator.hpp"
 #include "shared/async_world_generator.hpp"
 #include "shared/block_utils.hpp"
 #include "shared/chunk_archive.hpp"
+#include "shared/chunk_cache.hpp"
+#include "shared/net.hpp"
 
 class ServerChunkManager : public ChunkManager, public Thread {
 public:
 	static const int CHUNK_POOL_SIZE = 20000;
+	static const size_t CHUNK_CACHE_SIZE = 4096;
+	static const size_t MAX_JOURNAL_LENGTH = MAX_EDITS_PER_CHUNK_DELTA;
 
 private:
 	enum ArchiveOperationType {
@@ -33,38 +40,63 @@ private:
 		ArchiveOperationType type;
 	};
 
+	// loads and stores chunks on its own thread
+	class ArchiveWorker;
+
+	// the latest edits of a loaded chunk, the oldest one was applied to
+	// baseRevision
+	struct ChunkJournal {
+		uint32 baseRevision;
+		std::deque<ChunkEdit> edits;
+	};
+
 	Chunk *chunkPool[CHUNK_POOL_SIZE];
 	std::stack<Chunk *> unusedChunks;
 
 	std::queue<vec3i64> requestedQueue;
 	std::queue<Chunk *> toGenerateQueue;
 	std::queue<ArchiveOperation> prethreadInQueue;
-	ProducerQueue<ArchiveOperation> threadOutQueue;
-	ProducerQueue<ArchiveOperation> threadInQueue;
+	// operations on a chunk always go to the same worker, so they
+	// happen in the order they were queued in
+	std::vector<std::unique_ptr<ArchiveWorker>> archiveWorkers;
 	std::unordered_map<vec3i64, Chunk *, size_t(*)(vec3i64)> chunks;
 	std::unordered_map<vec3i64, uint32, size_t(*)(vec3i64)> cacheRevisions;
 	std::unordered_map<vec3i64, int, size_t(*)(vec3i64)> needCounter;
+	std::unordered_map<vec3i64, ChunkJournal, size_t(*)(vec3i64)> journals;
+	// released chunks that are in the archive as they are, requests for
+	// them don't need to load or generate anything
+	ChunkCache releasedChunks;
+	RecentlyEditedChunks editedChunks;
 
 	int numSessionChunkLoads = 0;
 	int numSessionChunkGens = 0;
+	int numSessionCacheHits = 0;
 
 	std::unique_ptr<WorldGenerator> worldGenerator;
 	AsyncWorldGenerator asyncWorldGenerator;
 
 	std::unique_ptr<ChunkArchive> archive;
+	// only touched by the maintenance thread
+	Time nextCompaction;
+	Time nextCheckpoint;
 
 public:
 	ServerChunkManager(std::unique_ptr<WorldGenerator> worldGenerator,
-			std::unique_ptr<ChunkArchive> archive);
+			std::unique_ptr<ChunkArchive> archive, int numArchiveWorkers = 4);
 	virtual ~ServerChunkManager();
 
 	void tick();
+	// checkpoints and compacts the archive while the workers handle the
+	// loads and stores
 	virtual void doWork() override;
-	virtual void onStop() override;
-	void storeChunks();
 
 	void placeBlock(vec3i64 chunkCoords, size_t intraChunkIndex,
 			uint blockType, uint32 revision);
+	// edits that bring the chunk from sinceRevision to its current
+	// revision, with only the last edit of every block, false if the
+	// journal doesn't reach back that far
+	bool getChunkEdits(vec3i64 chunkCoords, uint32 sinceRevision,
+			std::vector<ChunkEdit> *edits) const;
 
 	virtual const Chunk *getChunk(vec3i64 chunkCoords) const override;
 	virtual void requireChunk(vec3i64 chunkCoords) override;
@@ -79,10 +111,14 @@ public:
 
 	int getNumSessionChunkLoads() const { return numSessionChunkLoads; }
 	int getNumSessionChunkGens() const { return numSessionChunkGens; }
+	int getNumSessionCacheHits() const { return numSessionCacheHits; }
+	int getNumCachedChunks() const { return (int) releasedChunks.size(); }
 
 private:
 	void insertLoadedChunk(Chunk *chunk);
 	void insertReceivedChunk(Chunk *chunk);
+	void recordEdit(vec3i64 chunkCoords, uint32 oldRevision, size_t index, uint8 type);
+	void cacheChunk(Chunk *chunk);
 	void recycleChunk(Chunk *chunk);
 };
 
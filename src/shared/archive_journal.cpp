@@ -0,0 +1,246 @@
+#include "archive_journal.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "engine/logging.hpp"
+#include "engine/macros.hpp"
+
+#include "chunk_compression.hpp"
+
+static logging::Logger logger("io");
+
+static const uint8 MAGIC[4] = { 0x4A, 0x97, 0x22, 0xDF };
+
+static const int32 ENDIANESS_BYTES = 0x01020304;
+
+static const int32 RECENT_JOURNAL_VERSION = 1;
+
+PACKED(
+struct JournalHeader {
+	uint8 magic[4];
+	int32 endianess_bytes;
+	int32 version;
+});
+
+PACKED(
+struct RecordHeader {
+	// covers everything after itself, including the data
+	uint32 checksum;
+	uint32 size;
+	int64 cc[3];
+	uint32 revision;
+	uint16 flags;
+	uint16 pass_throughs;
+});
+
+static uint32 getChecksum(const RecordHeader &header, const uint8 *data) {
+	const size_t offset = sizeof(header.checksum);
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, (const Bytef *) &header + offset, sizeof(RecordHeader) - offset);
+	// crc32 starts over when given a null pointer
+	if (header.size > 0)
+		crc = crc32(crc, data, header.size);
+	return (uint32) crc;
+}
+
+void ArchiveJournal::makeRecord(const Chunk &chunk, Record *record) {
+	record->cc = chunk.getCC();
+	record->revision = chunk.getRevision();
+	record->flags = 0;
+	record->pass_throughs = 0;
+	record->data.clear();
+	if (chunk.isVisual()) {
+		record->flags |= RECORD_VISUAL;
+		record->pass_throughs = chunk.getPassThroughs();
+	}
+	if (chunk.isEmpty()) {
+		record->flags |= RECORD_EMPTY;
+		return;
+	}
+
+	uint8 blocks[Chunk::SIZE];
+	chunk.getBlocks(blocks);
+	// leave some wiggle room, so we can detect whether the chunk grew
+	record->data.resize(Chunk::SIZE + 4);
+	int bytes = encodeBlocks_RLE(blocks, record->data.data(), Chunk::SIZE);
+	if (bytes > 0 && bytes < (int) Chunk::SIZE) {
+		record->flags |= RECORD_RLE;
+		record->data.resize(bytes);
+	} else {
+		record->data.assign(blocks, blocks + Chunk::SIZE);
+	}
+}
+
+bool ArchiveJournal::initChunk(const Record &record, Chunk *chunk) {
+	chunk->initRevision(record.revision);
+	if (record.flags & RECORD_EMPTY) {
+		chunk->initUniform(0);
+		chunk->initNumAirBlocks(Chunk::SIZE);
+		chunk->initPassThroughs(0x7FFF);
+	} else {
+		uint8 blocks[Chunk::SIZE];
+		if (!decodeBlocks(record, blocks))
+			return false;
+		chunk->initBlocks(blocks);
+		if (record.flags & RECORD_VISUAL)
+			chunk->initPassThroughs(record.pass_throughs);
+	}
+	chunk->finishInitialization();
+	return true;
+}
+
+bool ArchiveJournal::decodeBlocks(const Record &record, uint8 *blocks) {
+	if (record.flags & RECORD_EMPTY)
+		return true;
+	if (record.flags & RECORD_RLE)
+		return decodeBlocks_RLE(record.data.data(), record.data.size(), blocks);
+	if (record.data.size() != Chunk::SIZE)
+		return false;
+	memcpy(blocks, record.data.data(), Chunk::SIZE);
+	return true;
+}
+
+bool ArchiveJournal::open(const char *filename, std::vector<Record> *records) {
+	_filename = filename;
+	_size = 0;
+	if (!_file.open(filename)) {
+		LOG_ERROR(logger) << "Could not open journal '" << _filename << "'";
+		return false;
+	}
+
+	if (_file.getSize() < sizeof(JournalHeader))
+		return writeHeader();
+
+	JournalHeader header;
+	memcpy(&header, _file.getData(), sizeof(JournalHeader));
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+			|| header.endianess_bytes != ENDIANESS_BYTES
+			|| header.version != RECENT_JOURNAL_VERSION) {
+		LOG_ERROR(logger) << "Journal '" << _filename << "' had bad header";
+		_file.close();
+		return false;
+	}
+
+	size_t pos = sizeof(JournalHeader);
+	while (pos + sizeof(RecordHeader) <= _file.getSize()) {
+		RecordHeader record_header;
+		memcpy(&record_header, _file.getData() + pos, sizeof(RecordHeader));
+		const uint8 *data = _file.getData() + pos + sizeof(RecordHeader);
+		if (record_header.size > _file.getSize() - pos - sizeof(RecordHeader)
+				|| record_header.checksum != getChecksum(record_header, data))
+			break;
+
+		Record record;
+		record.cc = vec3i64(record_header.cc[0], record_header.cc[1], record_header.cc[2]);
+		record.revision = record_header.revision;
+		record.flags = record_header.flags;
+		record.pass_throughs = record_header.pass_throughs;
+		record.data.assign(data, data + record_header.size);
+		records->push_back(std::move(record));
+		pos += sizeof(RecordHeader) + record_header.size;
+	}
+
+	// appending starts right after the last intact record
+	if (pos < _file.getSize()) {
+		LOG_WARNING(logger) << "Journal '" << _filename << "' ended with "
+				<< _file.getSize() - pos << " bytes of incomplete records";
+		if (!_file.truncate(pos)) {
+			_file.close();
+			return false;
+		}
+	}
+	_size = pos;
+	return true;
+}
+
+void ArchiveJournal::close() {
+	_file.close();
+	_size = 0;
+}
+
+bool ArchiveJournal::append(const std::vector<Record> &records) {
+	if (!_file.isOpen())
+		return false;
+
+	std::vector<uint8> bytes;
+	for (const Record &record : records) {
+		RecordHeader header;
+		header.size = (uint32) record.data.size();
+		header.cc[0] = record.cc[0];
+		header.cc[1] = record.cc[1];
+		header.cc[2] = record.cc[2];
+		header.revision = record.revision;
+		header.flags = record.flags;
+		header.pass_throughs = record.pass_throughs;
+		header.checksum = getChecksum(header, record.data.data());
+
+		const uint8 *header_bytes = (const uint8 *) &header;
+		bytes.insert(bytes.end(), header_bytes, header_bytes + sizeof(RecordHeader));
+		bytes.insert(bytes.end(), record.data.begin(), record.data.end());
+	}
+	if (bytes.empty())
+		return true;
+
+	// the whole batch is committed with a single write
+	if (!_file.write(_size, bytes.data(), bytes.size()) || !_file.sync()) {
+		LOG_ERROR(logger) << "Could not append to journal '" << _filename << "'";
+		return false;
+	}
+	_size += bytes.size();
+	return true;
+}
+
+bool ArchiveJournal::clear() {
+	if (!_file.isOpen())
+		return false;
+	if (!_file.truncate(sizeof(JournalHeader))) {
+		LOG_ERROR(logger) << "Could not clear journal '" << _filename << "'";
+		return false;
+	}
+	_size = sizeof(JournalHeader);
+	return true;
+}
+
+bool ArchiveJournal::rewrite(const std::vector<Record> &records) {
+	if (!_file.isOpen())
+		return false;
+
+	std::string new_filename = _filename + ".new";
+	std::remove(new_filename.c_str());
+	ArchiveJournal journal;
+	std::vector<Record> old_records;
+	bool success = journal.open(new_filename.c_str(), &old_records) && journal.append(records);
+	size_t size = journal.getSize();
+	journal.close();
+	if (!success || std::rename(new_filename.c_str(), _filename.c_str()) != 0) {
+		LOG_ERROR(logger) << "Could not rewrite journal '" << _filename << "'";
+		return false;
+	}
+
+	// the old file is gone, appending continues in the new one
+	_file.close();
+	if (!_file.open(_filename.c_str())) {
+		LOG_ERROR(logger) << "Could not open journal '" << _filename << "'";
+		_size = 0;
+		return false;
+	}
+	_size = size;
+	return true;
+}
+
+bool ArchiveJournal::writeHeader() {
+	JournalHeader header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.endianess_bytes = ENDIANESS_BYTES;
+	header.version = RECENT_JOURNAL_VERSION;
+	if (!_file.truncate(0) || !_file.write(0, &header, sizeof(JournalHeader)) || !_file.sync()) {
+		LOG_ERROR(logger) << "Could not initialize journal '" << _filename << "'";
+		_file.close();
+		return false;
+	}
+	_size = sizeof(JournalHeader);
+	return true;
+}
@@ -0,0 +1,67 @@
+#ifndef ARCHIVE_JOURNAL_HPP_
+#define ARCHIVE_JOURNAL_HPP_
+
+#include <string>
+#include <vector>
+
+#include "engine/std_types.hpp"
+#include "engine/vmath.hpp"
+#include "engine/mapped_file.hpp"
+
+#include "game/chunk.hpp"
+
+/** Append-only log of stored chunks that didn't make it into their region files yet
+
+	Every record holds a whole chunk and a checksum, so a record that was only partially
+	written when the process died is recognized on replay and dropped, together with
+	anything that follows it.
+*/
+class ArchiveJournal {
+public:
+	enum RecordFlags {
+		RECORD_EMPTY  = 0x0001,
+		RECORD_VISUAL = 0x0002,
+		RECORD_RLE    = 0x0004,
+	};
+
+	struct Record {
+		vec3i64 cc;
+		uint32 revision;
+		uint16 flags;
+		uint16 pass_throughs;
+		// blocks of the chunk, run length encoded if RECORD_RLE is set
+		std::vector<uint8> data;
+	};
+
+	static void makeRecord(const Chunk &, Record *);
+	// initializes a chunk with only its coordinates set
+	static bool initChunk(const Record &, Chunk *);
+	// blocks is left alone for empty chunks
+	static bool decodeBlocks(const Record &, uint8 *blocks);
+
+	ArchiveJournal() = default;
+	ArchiveJournal(const ArchiveJournal &) = delete;
+	ArchiveJournal &operator = (const ArchiveJournal &) = delete;
+
+	// reads all intact records of an existing journal
+	bool open(const char *filename, std::vector<Record> *records);
+	void close();
+
+	// the records are on the disk once this returns true
+	bool append(const std::vector<Record> &records);
+	bool clear();
+	// replaces the journal with one that holds only the given records, a
+	// crash leaves either the old or the new journal behind
+	bool rewrite(const std::vector<Record> &records);
+
+	size_t getSize() const { return _size; }
+
+private:
+	bool writeHeader();
+
+	MappedFile _file;
+	std::string _filename;
+	size_t _size = 0;
+};
+
+#endif // ARCHIVE_JOURNAL_HPP_
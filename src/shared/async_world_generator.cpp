@@ -1,34 +1,46 @@
 #include "async_world_generator.hpp"
 
+#include <algorithm>
 #include <thread>
 #include <atomic>
 
 #include "shared/engine/logging.hpp"
+#include "shared/engine/queue.hpp"
+#include "shared/engine/thread.hpp"
 
 using namespace std;
 
 static logging::Logger logger("local");
 
-AsyncWorldGenerator::AsyncWorldGenerator(WorldGenerator *worldGenerator) : Thread("AsyncChunkGenerator"),
-	worldGenerator(worldGenerator),
-	loadedQueue(1024),
-	toLoadQueue(1024)
-{
-	dispatch();
-}
+class AsyncWorldGenerator::Worker : public Thread {
+public:
+	Worker(WorldGenerator *worldGenerator) : Thread("AsyncChunkGenerator"),
+		loadedQueue(1024),
+		toLoadQueue(1024),
+		worldGenerator(worldGenerator)
+	{
+		dispatch();
+	}
 
-AsyncWorldGenerator::~AsyncWorldGenerator() {
-	Chunk *chunk;
-	requestTermination();
-	while (loadedQueue.pop(chunk));
-	wait();
-}
+	// only the thread that owns the AsyncWorldGenerator pushes and pops
+	ProducerQueue<Chunk *> loadedQueue;
+	ProducerQueue<Chunk *> toLoadQueue;
+
+	void doWork() override;
 
-void AsyncWorldGenerator::doWork() {
+private:
+	WorldGenerator *worldGenerator;
+	WorldGenerator::Context context;
+};
+
+void AsyncWorldGenerator::Worker::doWork() {
 	Chunk *chunk;
 	if (toLoadQueue.pop(chunk)) {
-		worldGenerator->generateChunk(chunk);
+		worldGenerator->generateChunk(chunk, &context);
 		while (!loadedQueue.push(chunk)) {
+			// nobody takes the chunks anymore
+			if (isTerminationRequested())
+				return;
 			sleepFor(millis(50));
 		}
 	} else {
@@ -36,12 +48,41 @@ void AsyncWorldGenerator::doWork() {
 	}
 }
 
+AsyncWorldGenerator::AsyncWorldGenerator(WorldGenerator *worldGenerator, int numWorkers) {
+	if (numWorkers <= 0)
+		numWorkers = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 0; i < numWorkers; i++)
+		workers.emplace_back(new Worker(worldGenerator));
+	LOG_DEBUG(logger) << "Generating chunks on " << numWorkers << " threads";
+}
+
+AsyncWorldGenerator::~AsyncWorldGenerator() {
+	for (auto &worker : workers)
+		worker->requestTermination();
+	for (auto &worker : workers) {
+		Chunk *chunk;
+		while (worker->loadedQueue.pop(chunk));
+		worker->wait();
+	}
+}
+
 bool AsyncWorldGenerator::generateChunk(Chunk *chunk) {
-	return toLoadQueue.push(chunk);
+	for (size_t i = 0; i < workers.size(); i++) {
+		Worker &worker = *workers[nextInWorker];
+		nextInWorker = (nextInWorker + 1) % workers.size();
+		if (worker.toLoadQueue.push(chunk))
+			return true;
+	}
+	return false;
 }
 
 Chunk *AsyncWorldGenerator::getNextChunk() {
 	Chunk *chunk = nullptr;
-	loadedQueue.pop(chunk);
-	return chunk;
+	for (size_t i = 0; i < workers.size(); i++) {
+		Worker &worker = *workers[nextOutWorker];
+		nextOutWorker = (nextOutWorker + 1) % workers.size();
+		if (worker.loadedQueue.pop(chunk))
+			return chunk;
+	}
+	return nullptr;
 }
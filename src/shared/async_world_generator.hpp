@@ -2,29 +2,33 @@
 #define ASYNC_WORLD_GENERATOR_HPP
 
 #include <memory>
+#include <vector>
 
-#include "engine/thread.hpp"
-
-#include "engine/queue.hpp"
 #include "game/world_generator.hpp"
 
-class AsyncWorldGenerator : public Thread {
-	WorldGenerator *worldGenerator;
+/** Generates chunks on a number of worker threads
+
+	All workers share the same world generator, each with its own scratch space.  Chunks are
+	handed to the workers in turns, so they don't come back in the order they were requested.
+	Only a single thread may request chunks and take them back.
+*/
+class AsyncWorldGenerator {
+	class Worker;
 
-	ProducerQueue<Chunk *> loadedQueue;
-	ProducerQueue<Chunk *> toLoadQueue;
+	std::vector<std::unique_ptr<Worker>> workers;
+	size_t nextInWorker = 0;
+	size_t nextOutWorker = 0;
 
 public:
-	AsyncWorldGenerator(WorldGenerator *worldGenerator);
+	// without a number of workers, there is one per hardware thread
+	AsyncWorldGenerator(WorldGenerator *worldGenerator, int numWorkers = 0);
 	~AsyncWorldGenerator();
 
-	// networking
-	void doWork() override;
-	
 	// chunks
 	bool generateChunk(Chunk *chunk);
 	Chunk *getNextChunk();
+
+	int getNumWorkers() const { return (int) workers.size(); }
 };
 
 #endif // ASYNC_WORLD_GENERATOR_HPP
-
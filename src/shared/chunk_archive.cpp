@@ -1,14 +1,23 @@
 #include "chunk_archive.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
 #include <cstring>
+#include <tuple>
 
 #include <boost/filesystem.hpp>
 
 #include "engine/math.hpp"
 #include "engine/logging.hpp"
+#include "engine/io_ring.hpp"
+#include "engine/mapped_file.hpp"
+#include "engine/mutex.hpp"
 
+#include "archive_journal.hpp"
 #include "block_utils.hpp"
 #include "chunk_compression.hpp"
+#include "heap_allocator.hpp"
 
 using namespace std;
 
@@ -19,12 +28,47 @@ static const uint8 MAGIC[4] = { 0x59, 0x97, 0x22, 0xDF };
 static const int32 ENDIANESS_BYTES = 0x01020304;
 static const int32 ENDIANESS_BYTES_FLIPPED = 0x04030201;
 
-static const uint HEAP_BLOCK_SIZE = 256;
+// deflated chunks are mostly around a hundred bytes
+static const uint HEAP_BLOCK_SIZE = 64;
 
 static const int32 RECENT_HEADER_VERSION = 3;
 
 static const uint REGION_SIZE = 16;
 
+// batched loads read over gaps of up to this many heap blocks between
+// chunks, rather than issuing another read
+static const uint32 MAX_READ_GAP_BLOCKS = 8;
+static const uint32 MAX_READ_RUN_BLOCKS = 16 * 1024;
+
+// the journal is applied to the region files once it grows this large
+static const size_t JOURNAL_CHECKPOINT_SIZE = 4 * 1024 * 1024;
+
+// how many regions without a file are remembered
+static const size_t MAX_MISSING_REGIONS = 64 * 1024;
+
+static const uint8 MANIFEST_MAGIC[4] = { 0x6D, 0x97, 0x22, 0xDF };
+
+static const int32 RECENT_MANIFEST_VERSION = 1;
+
+PACKED(
+struct Manifest {
+	uint8 magic[4];
+	int32 endianess_bytes;
+	int32 version;
+	int64 file_bytes;
+	int64 used_bytes;
+	int64 total_bytes;
+});
+
+static ChunkArchive::Statistics getChange(const ChunkArchive::Statistics &before,
+		const ChunkArchive::Statistics &after) {
+	ChunkArchive::Statistics change;
+	change.file_bytes = after.file_bytes - before.file_bytes;
+	change.used_bytes = after.used_bytes - before.used_bytes;
+	change.total_bytes = after.total_bytes - before.total_bytes;
+	return change;
+}
+
 class ArchiveFile {
 private:
 
@@ -56,7 +100,8 @@ private:
 		uint16 flags;
 		uint32 revision;
 		uint16 visibility;
-		uint8  reserved[2];
+		uint8  generator_version;
+		uint8  reserved[1];
 	});
 
 public:
@@ -67,7 +112,9 @@ public:
 	};
 
 	~ArchiveFile();
-	ArchiveFile(const char *, uint size = 16);
+	ArchiveFile(const char *, uint size = 16,
+			ArchiveCompression compression = ArchiveCompression::ZLIB,
+			WorldGenerator *generator = nullptr);
 
 	ArchiveFile() = delete;
 	ArchiveFile(const ArchiveFile &) = delete;
@@ -84,63 +131,100 @@ public:
 
 	bool hasChunk(vec3i64, uint32 *);
 	bool loadChunk(Chunk *);
-	void storeChunk(const Chunk &);
 
-	int getFileSize();
-	int getUsedChunkBytes();
-	int getTotalChunkBytes();
+	/** Load and store many chunks of the region at once
+
+		All chunks are read or written with a single batch of requests on the ring, or one after
+		another if there is no ring.  Loaded chunks are read in heap order, and chunks that lie
+		close together are read with a single request.  A chunk may only be stored once per
+		call.  loadChunks returns the number of loaded chunks, storeChunks whether all of them
+		were stored.
+	*/
+	int loadChunks(const std::vector<Chunk *> &, IORing *ring);
+	bool storeChunks(const std::vector<const ArchiveJournal::Record *> &, IORing *ring,
+			ChunkArchive::Statistics *change = nullptr);
+
+	bool sync();
+
+	// whether the file didn't exist before
+	bool wasCreated() const { return _created; }
+	ChunkArchive::Statistics getStatistics();
 	float getChunkFragmentation();
 
+	/** Rewrites the chunk heap without any holes
+
+		The chunks are copied in directory order into a new file, which then replaces the old
+		one.  If anything goes wrong, the old file stays as it was.
+	*/
+	bool compact(ChunkArchive::Statistics *change = nullptr);
+
 private:
-	size_t getChunkHeapStart();
+	struct EncodedChunk {
+		vec3i64 cc;
+		size_t id;
+		// everything but where the chunk goes
+		DirectoryEntry dir_entry;
+		uint num_blocks;
+		std::vector<uint8> data;
+	};
 
-	std::fstream _file;
+	size_t getChunkId(vec3i64 cc);
+	size_t getChunkHeapStart();
+	DirectoryEntry *getDirectory();
+	void rebuildHeap();
+	ChunkArchive::Statistics unsafe_getStatistics();
+	bool encodeChunk(const ArchiveJournal::Record &, EncodedChunk *);
+	bool initChunk(Chunk *, const DirectoryEntry &, const uint8 *stored, size_t size);
+	bool decodeHeapBlocks(const DirectoryEntry &, vec3i64 cc,
+			const uint8 *stored, size_t size, uint8 *blocks);
+	bool generateBlocks(vec3i64 cc, uint8 *blocks);
+
+	MappedFile _file;
 	const uint _region_size;
-	Time _last_access;
+	const ArchiveCompression _compression;
+	WorldGenerator *const _generator;
+	std::atomic<Time> _last_access;
 	std::string _filename;
-	bool _good = true;
+	std::atomic<bool> _good;
+	bool _created = false;
 
 	Header _header;
-	std::vector<DirectoryEntry> _dir;
+	// guarded by the store lock
+	HeapAllocator _heap;
+	uint32 _used_blocks = 0;
 
+	// guards the mapping, which moves when the file grows, and with it
+	// the directory and the chunks
 	ReadWriteLock _dir_lock;
+	// taken by whoever changes the directory or the heap
+	Mutex _store_lock;
 
 
 };
 
 ArchiveFile::~ArchiveFile() {
-	if(_file.is_open()) _file.close();
+	_file.close();
 }
 
-ArchiveFile::ArchiveFile(const char *filename, uint region_size) :
-	_region_size(region_size), _last_access(getCurrentTime()), _filename(filename)
+ArchiveFile::ArchiveFile(const char *filename, uint region_size,
+		ArchiveCompression compression, WorldGenerator *generator) :
+	_region_size(region_size), _compression(compression), _generator(generator),
+	_last_access(getCurrentTime()), _filename(filename),
+	_good(true)
 {
-	_file.open(_filename, ios_base::in | ios_base::out | ios_base::binary);
-	if (!_file.is_open()) {
-		// file might have not existed, try to create it
-		_file.clear();
-		_file.open(_filename, ios_base::out);
-		if (_file.is_open()) {
+	if (!_file.open(_filename.c_str())) {
+		LOG_ERROR(logger) << "Could not open ArchiveFile '" << _filename << "'";
+		_good = false;
+		return;
+	}
+
+	if (_file.getSize() == 0) {
+		// file was empty, we can safely nuke it (we probably created it)
+		_created = true;
+		initialize();
+		if (!_good) {
 			_file.close();
-		}
-		// try again
-		_file.clear();
-		_file.open(_filename, ios_base::in | ios_base::out | ios_base::binary);
-		if (!_file.is_open()) {
-			LOG_ERROR(logger) << "Could not open ArchiveFile '" << _filename << "'";
-			_good = false;
 			return;
-		} else {
-			int c = _file.get();
-			if (c == EOF) {
-				// file was empty, we can safely nuke it (we probably created it)
-				initialize();
-			} else {
-				LOG_ERROR(logger) << "ArchiveFile '" << _filename << "' had content after creation";
-				_file.close();
-				_good = false;
-				return;
-			}
 		}
 	}
 
@@ -161,17 +245,21 @@ ArchiveFile::ArchiveFile(const char *filename, uint region_size) :
 	}
 
 	loadDirectory();
+	if (!_good) {
+		_file.close();
+		return;
+	}
+
+	rebuildHeap();
 }
 
 void ArchiveFile::loadHeader() {
-	_file.clear();
-	_file.seekg(0);
-	_file.read((char *)(&_header), sizeof(Header));
-	if (_file.eof()) {
+	if (_file.getSize() < sizeof(Header)) {
 		LOG_ERROR(logger) << "Archive file '" << _filename << "' ended abruptly";
 		_good = false;
 		return;
 	}
+	memcpy(&_header, _file.getData(), sizeof(Header));
 
 	if (memcmp(_header.magic, MAGIC, sizeof(MAGIC)) != 0) {
 		LOG_ERROR(logger) << "Archive file '" << _filename << "' had wrong magic (0x"
@@ -202,21 +290,17 @@ void ArchiveFile::loadHeader() {
 		_good = false;
 		return;
 	}
-
-	_dir.clear();
-	_dir.resize(_header.dir_size);
-	memset((char *)_dir.data(), 0, _header.dir_size * sizeof(DirectoryEntry));
 }
 
 void ArchiveFile::loadDirectory() {
-	_file.seekg(_header.directory_offset);
-	_file.read((char *)(_dir.data()), _header.dir_size * sizeof (DirectoryEntry));
+	// the directory is used in place, it only has to be there
+	if (_file.getSize() < getChunkHeapStart()) {
+		LOG_ERROR(logger) << "Archive file '" << _filename << "' had a truncated directory";
+		_good = false;
+	}
 }
 
 void ArchiveFile::initialize() {
-	_file.clear();
-	_file.seekp(0);
-
 	memset((char *)&_header, 0, sizeof(Header));
 	memcpy(_header.magic, MAGIC, sizeof (MAGIC));
 	_header.endianess_bytes = ENDIANESS_BYTES;
@@ -227,33 +311,21 @@ void ArchiveFile::initialize() {
 	_header.heap_block_size = HEAP_BLOCK_SIZE;
 
 	// write header and empty directory
-	_file.write((char *)(&_header), sizeof (Header));
-	const size_t total_directory_bytes = num_chunks * sizeof(DirectoryEntry);
-	for (uint i = 0; i < total_directory_bytes; ++i) {
-		_file.put(0);
-	}
-	_file.flush();
-
-	if (!_file.good()) {
+	std::vector<uint8> bytes(getChunkHeapStart(), 0);
+	memcpy(bytes.data(), &_header, sizeof (Header));
+	if (!_file.write(0, bytes.data(), bytes.size())) {
 		LOG_ERROR(logger) << "Could not initialize ArchiveFile '" << _filename << "'";
 		_good = false;
 		return;
 	}
-
-	_dir.clear();
-	_dir.resize(_header.dir_size);
-	memset((char *)_dir.data(), 0, _header.dir_size * sizeof(DirectoryEntry));
 }
 
 bool ArchiveFile::hasChunk(vec3i64 cc, uint32 *revision) {
 	if (!_good) return false;
-	size_t x = cycle(cc[0], _region_size);
-	size_t y = cycle(cc[1], _region_size);
-	size_t z = cycle(cc[2], _region_size);
-	size_t id = x + (_region_size * (y + (_region_size * z)));
+	size_t id = getChunkId(cc);
 
 	_dir_lock.lockRead();
-	const DirectoryEntry dir_entry = _dir[id];
+	const DirectoryEntry dir_entry = getDirectory()[id];
 	_dir_lock.unlockRead();
 
 	bool has_chunk = dir_entry.size != 0 || dir_entry.flags != 0;
@@ -268,46 +340,147 @@ bool ArchiveFile::loadChunk(Chunk *chunk) {
 	_last_access = getCurrentTime();
 
 	// get entry from directory
-	vec3i64 cc = chunk->getCC();
-	size_t x = cycle(cc[0], _region_size);
-	size_t y = cycle(cc[1], _region_size);
-	size_t z = cycle(cc[2], _region_size);
-	size_t id = x + (_region_size * (y + (_region_size * z)));
+	size_t id = getChunkId(chunk->getCC());
 
 	_dir_lock.lockRead();
-	const DirectoryEntry dir_entry = _dir[id];
-	_dir_lock.unlockRead();
+	const DirectoryEntry dir_entry = getDirectory()[id];
 
 	if (dir_entry.size == 0 && dir_entry.flags == 0) {
+		_dir_lock.unlockRead();
 		return false;
 	}
-	
+
+	// copy the chunk out of the mapping, so it can be decoded while
+	// other chunks of the region are stored, the last chunk of the file
+	// doesn't fill its heap blocks
+	size_t start = getChunkHeapStart() + dir_entry.offset * _header.heap_block_size;
+	size_t end = std::min(start + dir_entry.size * _header.heap_block_size, _file.getSize());
+	std::vector<uint8> stored;
+	if (start < end)
+		stored.assign(_file.getData() + start, _file.getData() + end);
+	_dir_lock.unlockRead();
+
+	return initChunk(chunk, dir_entry, stored.data(), stored.size());
+}
+
+int ArchiveFile::loadChunks(const std::vector<Chunk *> &chunks, IORing *ring) {
+	if (!_good) return 0;
+
+	_last_access = getCurrentTime();
+
+	const size_t heap_start = getChunkHeapStart();
+	const uint hbs = _header.heap_block_size;
+
+	// chunks that lie close together in the heap are read together, in
+	// the order they are stored in
+	struct Run {
+		uint32 first_block;
+		uint32 end_block;
+		std::vector<uint8> bytes;
+	};
+	std::vector<DirectoryEntry> dir_entries(chunks.size());
+	std::vector<size_t> order;
+	std::vector<Run> runs;
+	std::vector<size_t> chunk_runs(chunks.size(), 0);
+
+	_dir_lock.lockRead();
+	const DirectoryEntry *dir = getDirectory();
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		dir_entries[i] = dir[getChunkId(chunks[i]->getCC())];
+		if (dir_entries[i].size > 0)
+			order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&dir_entries](size_t a, size_t b) {
+		return (uint32) dir_entries[a].offset < (uint32) dir_entries[b].offset;
+	});
+	for (size_t i : order) {
+		uint32 first = dir_entries[i].offset;
+		uint32 end = first + dir_entries[i].size;
+		if (runs.empty() || first > runs.back().end_block + MAX_READ_GAP_BLOCKS
+				|| end - runs.back().first_block > MAX_READ_RUN_BLOCKS) {
+			runs.push_back(Run{first, end, {}});
+		} else {
+			runs.back().end_block = std::max(runs.back().end_block, end);
+		}
+		chunk_runs[i] = runs.size() - 1;
+	}
+
+	std::vector<IORing::Request> requests;
+	for (Run &run : runs) {
+		run.bytes.resize((size_t) (run.end_block - run.first_block) * hbs);
+		requests.push_back({&_file, heap_start + (size_t) run.first_block * hbs,
+				run.bytes.data(), run.bytes.size(), false, 0, false});
+	}
+	// the reads finish before anyone may move the chunks
+	if (ring) {
+		ring->run(requests);
+	} else {
+		for (IORing::Request &request : requests) {
+			size_t end = std::min(request.offset + request.size, _file.getSize());
+			request.done = request.offset < end ? end - request.offset : 0;
+			if (request.done > 0)
+				memcpy(request.buffer, _file.getData() + request.offset, request.done);
+		}
+	}
+	_dir_lock.unlockRead();
+
+	// the last chunk of the file doesn't fill its heap blocks
+	for (size_t r = 0; r < runs.size(); ++r)
+		runs[r].bytes.resize(requests[r].failed ? 0 : requests[r].done);
+
+	int num_loaded = 0;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (dir_entries[i].size == 0 && dir_entries[i].flags == 0)
+			continue;
+		const uint8 *stored = nullptr;
+		size_t size = 0;
+		if (dir_entries[i].size > 0) {
+			const Run &run = runs[chunk_runs[i]];
+			size_t start = (size_t) (dir_entries[i].offset - run.first_block) * hbs;
+			size_t end = std::min(start + (size_t) dir_entries[i].size * hbs, run.bytes.size());
+			if (start < end) {
+				stored = run.bytes.data() + start;
+				size = end - start;
+			}
+		}
+		if (initChunk(chunks[i], dir_entries[i], stored, size))
+			++num_loaded;
+	}
+	return num_loaded;
+}
+
+bool ArchiveFile::initChunk(Chunk *chunk, const DirectoryEntry &dir_entry,
+		const uint8 *stored, size_t size) {
+	vec3i64 cc = chunk->getCC();
 	chunk->initRevision(dir_entry.revision);
+
 	if (dir_entry.flags == LAYOUT_EMPTY) {
-		uint8 *blocks = chunk->getBlocksForInit();
-		memset((char *)blocks, 0, Chunk::SIZE * sizeof(uint8));
+		chunk->initUniform(0);
 		chunk->initNumAirBlocks(Chunk::SIZE);
 		chunk->initPassThroughs(0x7FFF);
 		chunk->finishInitialization();
 		return true;
 	}
 
-	_file.seekg(getChunkHeapStart() + dir_entry.offset * _header.heap_block_size);
-
-	if ((dir_entry.flags & LAYOUT_ENC_MASK) == LAYOUT_RLE) {
-		decodeBlocks_RLE(&_file, chunk->getBlocksForInit());
-	} else if ((dir_entry.flags & LAYOUT_ENC_MASK) == LAYOUT_PLAIN) {
-		decodeBlocks_PLAIN(&_file, chunk->getBlocksForInit());
-	} else {
+	uint16 encoding = dir_entry.flags & LAYOUT_ENC_MASK;
+	if (encoding == (LAYOUT_RLE | LAYOUT_DIFF) || encoding == LAYOUT_ENC_MASK) {
 		LOG_ERROR(logger) << "Chunk Layout " << dir_entry.flags << " unsupported";
 		return false;
 	}
 
-	if (!_file.good()) {
-		LOG_ERROR(logger) << "Bad in-stream";
+	if (size == 0) {
+		LOG_ERROR(logger) << "Chunk (" << cc << ") lies outside of the file";
 		return false;
 	}
 
+	uint8 blocks[Chunk::SIZE];
+	if (!decodeHeapBlocks(dir_entry, cc, stored, size, blocks)) {
+		LOG_ERROR(logger) << "Chunk (" << cc << ") could not be decoded";
+		return false;
+	}
+
+	chunk->initBlocks(blocks);
+
 	if (dir_entry.flags & LAYOUT_VISIBILITY)
 		chunk->initPassThroughs(dir_entry.visibility);
 
@@ -316,135 +489,431 @@ bool ArchiveFile::loadChunk(Chunk *chunk) {
 	return true;
 }
 
-void ArchiveFile::storeChunk(const Chunk &chunk) {
-	if (!_good) return;
-
-	_last_access = getCurrentTime();
-
-	vec3i64 cc = chunk.getCC();
-	size_t x = cycle(cc[0], _region_size);
-	size_t y = cycle(cc[1], _region_size);
-	size_t z = cycle(cc[2], _region_size);
-	size_t id = x + (_region_size * (y + (_region_size * z)));
-
-	_dir_lock.lockRead();
-	DirectoryEntry dir_entry = _dir[id];
-	_dir_lock.unlockRead();
-
-	dir_entry.revision = chunk.getRevision();
-
-	if (chunk.isEmpty()) {
-		dir_entry.offset = 0;
-		dir_entry.size = 0;
-		dir_entry.visibility = 0;
-		dir_entry.flags = LAYOUT_EMPTY;
-	}
-	
-	else {
-		// leave some wiggle room, so we can detect whether a chunk actually grew
-		uint8 *const buffer = new uint8[Chunk::SIZE + 4];
-		int bytes_written;
-		uint num_blocks;
+bool ArchiveFile::encodeChunk(const ArchiveJournal::Record &record, EncodedChunk *encoded) {
+	vec3i64 cc = record.cc;
+
+	uint16 flags = LAYOUT_EMPTY;
+	uint8 generator_version = 0;
+	uint16 visibility = 0;
+	uint num_blocks = 0;
+	int bytes_written = 0;
+
+	// leave some wiggle room, so we can detect whether a chunk actually grew
+	uint8 *const buffer = new uint8[Chunk::SIZE + 4];
+	uint8 *const deflated = new uint8[Chunk::SIZE + 4];
+	uint8 *data = buffer;
+
+	if (!(record.flags & ArchiveJournal::RECORD_EMPTY)) {
+		uint8 blocks[Chunk::SIZE];
+		if (!ArchiveJournal::decodeBlocks(record, blocks)) {
+			LOG_ERROR(logger) << "Chunk (" << cc << ") could not be decoded";
+			delete[] buffer;
+			delete[] deflated;
+			return false;
+		}
 
 		// try RLE encoding
-		bytes_written = encodeBlocks_RLE(chunk.getBlocks(), buffer, Chunk::SIZE);
+		bytes_written = encodeBlocks_RLE(blocks, buffer, Chunk::SIZE);
 		if (bytes_written <= 0) {
 			LOG_ERROR(logger) << "Chunk (" << cc << ") could not be written";
-			return;
+			delete[] buffer;
+			delete[] deflated;
+			return false;
 		}
 		num_blocks = ((uint)bytes_written - 1) / _header.heap_block_size + 1;
-		dir_entry.flags = LAYOUT_RLE;
+		flags = LAYOUT_RLE;
 
 		// use plain encoding if we didn't compress the chunk enough
 		if (num_blocks >= Chunk::SIZE / _header.heap_block_size) {
-			bytes_written = encodeBlocks_PLAIN(chunk.getBlocks(), buffer, Chunk::SIZE);
+			bytes_written = encodeBlocks_PLAIN(blocks, buffer, Chunk::SIZE);
 			if (bytes_written <= 0) {
 				LOG_ERROR(logger) << "Chunk (" << cc << ") could not be written";
-				return;
+				delete[] buffer;
+				delete[] deflated;
+				return false;
 			}
 			num_blocks = ((uint)bytes_written - 1) / _header.heap_block_size + 1;
-			dir_entry.flags = LAYOUT_PLAIN;
+			flags = LAYOUT_PLAIN;
 		}
 
-		if (num_blocks > dir_entry.size) {
-			//LOG_DEBUG(logger) << "Resized Chunk (" << cc << ")";
-			_file.seekg(0, ios_base::end);
-			size_t file_end = (size_t) _file.tellg();
-			size_t chunk_heap_size = file_end - getChunkHeapStart();
-			size_t start;
-			if (chunk_heap_size > 0)
-				start = (chunk_heap_size - 1) / _header.heap_block_size + 1;
-			else
-				start = 0;
-			dir_entry.offset = (uint32) start;
-			dir_entry.size = num_blocks;
+		// store only what was changed since the chunk was generated if
+		// that is even smaller
+		if (_compression == ArchiveCompression::DIFF) {
+			uint8 *const generated = new uint8[Chunk::SIZE];
+			uint8 *const diff = new uint8[Chunk::SIZE];
+			int diff_bytes = -1;
+			if (generateBlocks(cc, generated))
+				diff_bytes = encodeBlocks_DIFF(blocks, generated, diff, bytes_written - 1);
+			if (diff_bytes > 0) {
+				memcpy(buffer, diff, diff_bytes);
+				bytes_written = diff_bytes;
+				num_blocks = ((uint)bytes_written - 1) / _header.heap_block_size + 1;
+				flags = LAYOUT_DIFF;
+				generator_version = _generator->getVersion();
+			}
+			delete[] generated;
+			delete[] diff;
+		}
+
+		// deflate the encoded chunk if that saves space
+		if (_compression != ArchiveCompression::RLE) {
+			int deflated_bytes = encodeBlocks_ZLIB(buffer, bytes_written, deflated, bytes_written - 1);
+			if (deflated_bytes > 0) {
+				data = deflated;
+				bytes_written = deflated_bytes;
+				num_blocks = ((uint)bytes_written - 1) / _header.heap_block_size + 1;
+				flags |= LAYOUT_ZLIB;
+			}
 		}
 
-		_file.seekp(getChunkHeapStart() + dir_entry.offset * _header.heap_block_size);
-		_file.write((char *) buffer, bytes_written);
-		_file.flush();
+		if (record.flags & ArchiveJournal::RECORD_VISUAL) {
+			flags |= LAYOUT_VISIBILITY;
+			visibility = record.pass_throughs;
+		}
+	}
 
-		delete[] buffer;
+	encoded->cc = cc;
+	encoded->id = getChunkId(cc);
+	memset(&encoded->dir_entry, 0, sizeof(DirectoryEntry));
+	encoded->dir_entry.revision = record.revision;
+	encoded->dir_entry.flags = flags;
+	encoded->dir_entry.visibility = visibility;
+	encoded->dir_entry.generator_version = generator_version;
+	encoded->num_blocks = num_blocks;
+	encoded->data.assign(data, data + bytes_written);
+
+	delete[] buffer;
+	delete[] deflated;
+	return true;
+}
 
-		if (chunk.isVisual()) {
-			dir_entry.flags |= LAYOUT_VISIBILITY;
-			dir_entry.visibility = chunk.getPassThroughs();
-		} else {
-			dir_entry.visibility = 0;
+bool ArchiveFile::storeChunks(const std::vector<const ArchiveJournal::Record *> &records,
+		IORing *ring, ChunkArchive::Statistics *change) {
+	if (!_good) return false;
+
+	_last_access = getCurrentTime();
+
+	// the chunks are encoded before any locks are taken
+	bool success = true;
+	std::vector<EncodedChunk> encoded;
+	encoded.reserve(records.size());
+	for (const ArchiveJournal::Record *record : records) {
+		encoded.emplace_back();
+		if (!encodeChunk(*record, &encoded.back())) {
+			encoded.pop_back();
+			success = false;
 		}
 	}
 
+	// only one batch of the region is placed at a time
+	_store_lock.lock();
+	ChunkArchive::Statistics before = unsafe_getStatistics();
+
+	// only stores change the directory, so it can be read without the
+	// directory lock
+	const size_t heap_start = getChunkHeapStart();
+	const uint hbs = _header.heap_block_size;
+	std::vector<DirectoryEntry> dir_entries(encoded.size());
+	// blocks the chunks don't need anymore, freed once the directory
+	// doesn't point to them
+	std::vector<HeapAllocator::Extent> freed(encoded.size(), HeapAllocator::Extent(0, 0));
+	std::vector<HeapAllocator::Extent> allocated(encoded.size(), HeapAllocator::Extent(0, 0));
+	std::vector<uint32> old_sizes(encoded.size());
+	size_t end = _file.getSize();
+	for (size_t i = 0; i < encoded.size(); ++i) {
+		const EncodedChunk &chunk = encoded[i];
+		DirectoryEntry &dir_entry = dir_entries[i];
+		dir_entry = chunk.dir_entry;
+		dir_entry.offset = getDirectory()[chunk.id].offset;
+		dir_entry.size = getDirectory()[chunk.id].size;
+		old_sizes[i] = dir_entry.size;
+		uint num_blocks = chunk.num_blocks;
+		if (num_blocks == 0) {
+			freed[i] = HeapAllocator::Extent((uint32) dir_entry.offset, (uint32) dir_entry.size);
+			dir_entry.offset = 0;
+			dir_entry.size = 0;
+		} else if (num_blocks > dir_entry.size) {
+			//LOG_DEBUG(logger) << "Resized Chunk (" << cc << ")";
+			freed[i] = HeapAllocator::Extent((uint32) dir_entry.offset, (uint32) dir_entry.size);
+			dir_entry.offset = _heap.allocate(num_blocks);
+			dir_entry.size = num_blocks;
+			allocated[i] = HeapAllocator::Extent((uint32) dir_entry.offset, num_blocks);
+		} else if (num_blocks < dir_entry.size) {
+			freed[i] = HeapAllocator::Extent(dir_entry.offset + num_blocks, dir_entry.size - num_blocks);
+			dir_entry.size = num_blocks;
+		}
+		if (num_blocks > 0)
+			end = std::max(end, heap_start + (size_t) dir_entry.offset * hbs + chunk.data.size());
+	}
+
+	std::vector<IORing::Request> requests;
+	std::vector<size_t> requested;
+	for (size_t i = 0; i < encoded.size(); ++i) {
+		if (encoded[i].num_blocks == 0)
+			continue;
+		size_t start = heap_start + (size_t) dir_entries[i].offset * hbs;
+		requests.push_back({&_file, start, encoded[i].data.data(), encoded[i].data.size(),
+				true, 0, false});
+		requested.push_back(i);
+	}
+
+	// growing the file can move the mapping, and loads must not see
+	// half written chunks
+	std::vector<bool> written(encoded.size(), true);
 	_dir_lock.lockWrite();
-	_dir[id] = dir_entry;
+	bool grown = end <= _file.getSize() || _file.truncate(end);
+	if (!grown) {
+		written.assign(encoded.size(), false);
+	} else if (ring) {
+		ring->run(requests);
+		for (size_t r = 0; r < requests.size(); ++r)
+			written[requested[r]] = !requests[r].failed;
+	} else {
+		for (size_t r = 0; r < requests.size(); ++r) {
+			const IORing::Request &request = requests[r];
+			written[requested[r]] = _file.write(request.offset, request.buffer, request.size);
+		}
+	}
+	for (size_t i = 0; i < encoded.size(); ++i) {
+		if (written[i])
+			getDirectory()[encoded[i].id] = dir_entries[i];
+	}
 	_dir_lock.unlockWrite();
 
-	_file.seekp(_header.directory_offset + id * sizeof (DirectoryEntry));
-	_file.write((char *)(&dir_entry), sizeof (DirectoryEntry));
-	_file.flush();
+	for (size_t i = 0; i < encoded.size(); ++i) {
+		if (written[i]) {
+			_used_blocks += dir_entries[i].size - old_sizes[i];
+			_heap.free(freed[i].first, freed[i].second);
+		} else {
+			_heap.free(allocated[i].first, allocated[i].second);
+			LOG_ERROR(logger) << "Safe operation failed for chunk (" << encoded[i].cc << ")";
+			success = false;
+		}
+	}
 
-	if (!_file.good()) {
-		LOG_ERROR(logger) << "Safe operation failed for chunk "
-				<< cc[0] << " " << cc[1] << " "<< cc[2];
+	if (change) {
+		*change = getChange(before, unsafe_getStatistics());
 	}
+	_store_lock.unlock();
+
+	return success;
 }
 
-int ArchiveFile::getFileSize() {
-	using namespace boost::filesystem;
-	return (int) file_size(path(_filename));
+bool ArchiveFile::sync() {
+	if (!_good) return false;
+	_dir_lock.lockRead();
+	bool result = _file.sync();
+	_dir_lock.unlockRead();
+	return result;
 }
 
-int ArchiveFile::getUsedChunkBytes() {
-	size_t blocks = 0;
-	for (auto &entry : _dir) {
-		blocks += entry.size;
-	}
-	return (int) blocks * _header.heap_block_size;
+ChunkArchive::Statistics ArchiveFile::getStatistics() {
+	_store_lock.lock();
+	ChunkArchive::Statistics statistics = unsafe_getStatistics();
+	_store_lock.unlock();
+	return statistics;
 }
 
-int ArchiveFile::getTotalChunkBytes() {
-	size_t blocks = 0;
-	for (auto &entry : _dir) {
-		blocks = std::max(blocks, (size_t) entry.size + entry.offset);
-	}
-	return (int) blocks * _header.heap_block_size;
+// the caller of this function needs to hold the store lock
+ChunkArchive::Statistics ArchiveFile::unsafe_getStatistics() {
+	ChunkArchive::Statistics statistics;
+	if (!_good) return statistics;
+	statistics.file_bytes = (int64) _file.getSize();
+	statistics.used_bytes = (int64) _used_blocks * _header.heap_block_size;
+	// freed blocks at the end of the heap count as well
+	statistics.total_bytes = (int64) _heap.getEnd() * _header.heap_block_size;
+	return statistics;
 }
 
 float ArchiveFile::getChunkFragmentation() {
-	size_t used = getUsedChunkBytes();
-	size_t total = getTotalChunkBytes();
+	ChunkArchive::Statistics statistics = getStatistics();
+	int64 used = statistics.used_bytes;
+	int64 total = statistics.total_bytes;
 	return total > 0 ? (float) (total - used) / total : 0.0f;
 }
 
+size_t ArchiveFile::getChunkId(vec3i64 cc) {
+	size_t x = cycle(cc[0], _region_size);
+	size_t y = cycle(cc[1], _region_size);
+	size_t z = cycle(cc[2], _region_size);
+	return x + (_region_size * (y + (_region_size * z)));
+}
+
 size_t ArchiveFile::getChunkHeapStart() {
 	return _header.directory_offset + _header.dir_size * sizeof(DirectoryEntry);
 }
 
+ArchiveFile::DirectoryEntry *ArchiveFile::getDirectory() {
+	return (DirectoryEntry *) (_file.getData() + _header.directory_offset);
+}
+
+void ArchiveFile::rebuildHeap() {
+	const DirectoryEntry *dir = getDirectory();
+	std::vector<HeapAllocator::Extent> used;
+	_used_blocks = 0;
+	for (uint i = 0; i < _header.dir_size; ++i) {
+		if (dir[i].size > 0)
+			used.push_back(HeapAllocator::Extent((uint32) dir[i].offset, (uint32) dir[i].size));
+		_used_blocks += dir[i].size;
+	}
+	size_t heap_bytes = _file.getSize() - getChunkHeapStart();
+	uint32 end = (uint32) ((heap_bytes + _header.heap_block_size - 1) / _header.heap_block_size);
+	_heap.rebuild(used, end);
+}
+
+bool ArchiveFile::compact(ChunkArchive::Statistics *change) {
+	if (!_good) return false;
+
+	using namespace boost::filesystem;
+	std::string compact_filename = _filename + ".compact";
+	boost::system::error_code ec;
+	remove(path(compact_filename), ec);
+
+	// nothing may be stored or loaded while the file is replaced
+	_store_lock.lock();
+	_dir_lock.lockWrite();
+	ChunkArchive::Statistics before = unsafe_getStatistics();
+
+	const size_t heap_start = getChunkHeapStart();
+	const uint hbs = _header.heap_block_size;
+	const DirectoryEntry *dir = getDirectory();
+	std::vector<DirectoryEntry> new_dir(dir, dir + _header.dir_size);
+	uint32 num_blocks = 0;
+	for (DirectoryEntry &dir_entry : new_dir) {
+		dir_entry.offset = dir_entry.size > 0 ? num_blocks : 0;
+		num_blocks += dir_entry.size;
+	}
+
+	MappedFile compacted;
+	bool success = compacted.open(compact_filename.c_str());
+
+	// sizing the file up front keeps the writes from moving the mapping
+	size_t new_size = heap_start + (size_t) num_blocks * hbs;
+	const uint8 zero = 0;
+	if (success && num_blocks > 0)
+		success = compacted.write(new_size - 1, &zero, 1);
+
+	for (uint i = 0; success && i < _header.dir_size; ++i) {
+		if (dir[i].size == 0)
+			continue;
+		// the last chunk of the file doesn't fill its heap blocks
+		size_t start = heap_start + (size_t) dir[i].offset * hbs;
+		size_t end = std::min(start + (size_t) dir[i].size * hbs, _file.getSize());
+		if (start >= end) {
+			LOG_ERROR(logger) << "Chunk " << i << " of ArchiveFile '" << _filename
+					<< "' lies outside of the file";
+			success = false;
+			break;
+		}
+		success = compacted.write(heap_start + (size_t) new_dir[i].offset * hbs,
+				_file.getData() + start, end - start);
+	}
+
+	success = success
+			&& compacted.write(0, &_header, sizeof(Header))
+			&& compacted.write(_header.directory_offset, new_dir.data(),
+					new_dir.size() * sizeof(DirectoryEntry))
+			&& compacted.sync();
+	compacted.close();
+
+	size_t old_size = _file.getSize();
+	if (success) {
+		// open files can't be replaced everywhere
+		_file.close();
+		rename(path(compact_filename), path(_filename), ec);
+		if (ec) {
+			LOG_ERROR(logger) << "Could not replace ArchiveFile '" << _filename << "' ("
+					<< ec.message() << ")";
+			success = false;
+		}
+		if (!_file.open(_filename.c_str())) {
+			LOG_ERROR(logger) << "Could not reopen ArchiveFile '" << _filename << "'";
+			_good = false;
+		} else {
+			loadHeader();
+			if (_good)
+				loadDirectory();
+			if (_good)
+				rebuildHeap();
+		}
+	}
+	if (!success)
+		remove(path(compact_filename), ec);
+
+	if (change) {
+		*change = getChange(before, unsafe_getStatistics());
+	}
+	_dir_lock.unlockWrite();
+	_store_lock.unlock();
+
+	if (success) {
+		LOG_DEBUG(logger) << "Compacted ArchiveFile '" << _filename << "' from "
+				<< old_size / 1024 << " KB to " << new_size / 1024 << " KB";
+	}
+	return success && _good;
+}
+
+bool ArchiveFile::decodeHeapBlocks(const DirectoryEntry &dir_entry, vec3i64 cc,
+		const uint8 *stored, size_t size, uint8 *blocks) {
+	// the exact size isn't stored, but zlib knows where its stream ends and
+	// a diff starts with its length
+	uint8 *const encoded = new uint8[Chunk::SIZE];
+	const uint8 *data = stored;
+	int encoded_bytes = (int) size;
+	if (dir_entry.flags & LAYOUT_ZLIB) {
+		encoded_bytes = decodeBlocks_ZLIB(stored, size, encoded, Chunk::SIZE);
+		data = encoded;
+	}
+
+	bool success = encoded_bytes >= 0;
+	if (success && (dir_entry.flags & LAYOUT_DIFF)) {
+		if (_generator && dir_entry.generator_version != _generator->getVersion()) {
+			LOG_ERROR(logger) << "Chunk (" << cc << ") was stored for world generator version "
+					<< (int) dir_entry.generator_version << ", not " << (int) _generator->getVersion();
+			success = false;
+		} else {
+			// the diff is applied to the generated blocks in place
+			success = generateBlocks(cc, blocks)
+					&& decodeBlocks_DIFF(data, encoded_bytes, blocks, blocks);
+		}
+	} else if (success && (dir_entry.flags & LAYOUT_RLE)) {
+		success = decodeBlocks_RLE(data, encoded_bytes, blocks);
+	} else if (success) {
+		success = encoded_bytes >= (int) Chunk::SIZE;
+		if (success)
+			memcpy(blocks, data, Chunk::SIZE);
+	}
+
+	delete[] encoded;
+	return success;
+}
+
+bool ArchiveFile::generateBlocks(vec3i64 cc, uint8 *blocks) {
+	if (!_generator) {
+		LOG_ERROR(logger) << "No world generator to regenerate chunk (" << cc << ")";
+		return false;
+	}
+	Chunk chunk;
+	chunk.initCC(cc);
+	_generator->generateChunk(&chunk);
+	chunk.getBlocks(blocks);
+	return true;
+}
+
 ChunkArchive::~ChunkArchive() {
+	checkpoint();
+	storeManifest();
 	clean();
 }
 
-ChunkArchive::ChunkArchive(const char *str) :
-	_path(str), _file_map(0, vec3i64HashFunc)
+ChunkArchive::ChunkArchive(const char *str, ArchiveCompression compression,
+		std::unique_ptr<WorldGenerator> generator, size_t max_open_regions) :
+	_path(str), _compression(compression), _generator(std::move(generator)),
+	_file_map(0, vec3i64HashFunc),
+	_max_open_regions(std::max<size_t>(max_open_regions, 1)),
+	_missing_regions(0, vec3i64HashFunc),
+	_closed_regions(0, vec3i64HashFunc),
+	_pending(0, vec3i64HashFunc)
 {
 	using namespace boost::filesystem;
 	path p(str);
@@ -457,48 +926,349 @@ ChunkArchive::ChunkArchive(const char *str) :
 		}
 	}
 
-	size_t bytes = 0;
-	size_t used_bytes = 0;
-	size_t total_bytes = 0;
-
-	directory_iterator iter(str);
-	directory_iterator end;
-	while (iter != end) {
-		if (exists(iter->path()) && is_regular_file(iter->path())) {
-			ArchiveFile af(iter->path().string().c_str());
-			bytes += af.getFileSize();
-			used_bytes += af.getUsedChunkBytes();
-			total_bytes += af.getTotalChunkBytes();
+	if (!loadManifest()) {
+		LOG_INFO(logger) << "Chunk archive '" << str << "' has no manifest, scanning regions";
+		directory_iterator iter(str);
+		directory_iterator end;
+		while (iter != end) {
+			if (is_regular_file(iter->path()) && iter->path().extension() == ".region") {
+				ArchiveFile af(iter->path().string().c_str());
+				addStatistics(af.getStatistics());
+			}
+			++iter;
 		}
-		++iter;
+		_statistics_changed = true;
+		storeManifest();
 	}
 
-	LOG_INFO(logger) << "Chunk archive '" << str << "' has " << bytes / 1024 / 1024 << " MB";
+	LOG_INFO(logger) << "Chunk archive '" << str << "' has "
+			<< _statistics.file_bytes / 1024 / 1024 << " MB";
 	LOG_INFO(logger) << "Chunk archive '" << str << "' uses "
-			<< used_bytes / 1024 / 1024 << " MB of " << total_bytes / 1024 / 1024 << " MB of space";
+			<< _statistics.used_bytes / 1024 / 1024 << " MB of "
+			<< _statistics.total_bytes / 1024 / 1024 << " MB of space";
+
+	// whatever is still in the journal didn't make it into the region files
+	std::vector<ArchiveJournal::Record> records;
+	std::string journal_filename = _path + "chunks.journal";
+	_journal_good = _journal.open(journal_filename.c_str(), &records);
+	if (!records.empty()) {
+		LOG_INFO(logger) << "Replaying " << records.size() << " journaled chunks";
+		for (auto &record : records)
+			_pending[record.cc] = std::move(record);
+		checkpoint();
+	}
 }
 
 bool ChunkArchive::hasChunk(vec3i64 cc, uint32 *revision) {
+	_pending_lock.lockRead();
+	auto iter = _pending.find(cc);
+	if (iter != _pending.end()) {
+		if (revision != nullptr)
+			*revision = iter->second.revision;
+		_pending_lock.unlockRead();
+		return true;
+	}
+	_pending_lock.unlockRead();
+
 	_file_map_lock.lockRead();
-	ArchiveFile *archive_file = unsafe_getArchiveFile(cc);
-	bool result = archive_file->hasChunk(cc, revision);
+	ArchiveFile *archive_file = unsafe_getArchiveFile(getRegionCoords(cc), false);
+	bool result = archive_file && archive_file->hasChunk(cc, revision);
 	_file_map_lock.unlockRead();
 	return result;
 }
 
 bool ChunkArchive::loadChunk(Chunk *chunk) {
+	_pending_lock.lockRead();
+	auto iter = _pending.find(chunk->getCC());
+	if (iter != _pending.end()) {
+		bool result = ArchiveJournal::initChunk(iter->second, chunk);
+		_pending_lock.unlockRead();
+		return result;
+	}
+	_pending_lock.unlockRead();
+
 	_file_map_lock.lockRead();
-	ArchiveFile *archive_file = unsafe_getArchiveFile(chunk->getCC());
-	bool result = archive_file->loadChunk(chunk);
+	ArchiveFile *archive_file = unsafe_getArchiveFile(getRegionCoords(chunk->getCC()), false);
+	bool result = archive_file && archive_file->loadChunk(chunk);
 	_file_map_lock.unlockRead();
 	return result;
 }
 
+int ChunkArchive::loadChunks(const std::vector<Chunk *> &chunks, IORing *ring) {
+	int num_loaded = 0;
+	std::vector<Chunk *> stored;
+	_pending_lock.lockRead();
+	for (Chunk *chunk : chunks) {
+		auto iter = _pending.find(chunk->getCC());
+		if (iter == _pending.end())
+			stored.push_back(chunk);
+		else if (ArchiveJournal::initChunk(iter->second, chunk))
+			++num_loaded;
+	}
+	_pending_lock.unlockRead();
+
+	// region by region
+	std::sort(stored.begin(), stored.end(), [](const Chunk *a, const Chunk *b) {
+		vec3i64 rca = getRegionCoords(a->getCC());
+		vec3i64 rcb = getRegionCoords(b->getCC());
+		return std::make_tuple(rca[2], rca[1], rca[0]) < std::make_tuple(rcb[2], rcb[1], rcb[0]);
+	});
+	size_t i = 0;
+	while (i < stored.size()) {
+		vec3i64 rc = getRegionCoords(stored[i]->getCC());
+		std::vector<Chunk *> region_chunks;
+		for (; i < stored.size() && getRegionCoords(stored[i]->getCC()) == rc; ++i)
+			region_chunks.push_back(stored[i]);
+		_file_map_lock.lockRead();
+		ArchiveFile *archive_file = unsafe_getArchiveFile(rc, false);
+		if (archive_file)
+			num_loaded += archive_file->loadChunks(region_chunks, ring);
+		_file_map_lock.unlockRead();
+	}
+	return num_loaded;
+}
+
 void ChunkArchive::storeChunk(const Chunk &chunk) {
+	storeChunks(std::vector<const Chunk *>(1, &chunk));
+}
+
+void ChunkArchive::storeChunks(const std::vector<const Chunk *> &chunks) {
+	std::vector<ArchiveJournal::Record> records(chunks.size());
+	for (size_t i = 0; i < chunks.size(); ++i)
+		ArchiveJournal::makeRecord(*chunks[i], &records[i]);
+
+	// the journal and the pending chunks have to agree on the order of
+	// the stores
+	_journal_lock.lock();
+	bool journaled = _journal_good && _journal.append(records);
+
+	_pending_lock.lockWrite();
+	for (auto &record : records)
+		_pending[record.cc] = std::move(record);
+	_pending_lock.unlockWrite();
+
+	// without a journal the chunks go straight to their region files
+	bool needs_checkpoint = !journaled || _journal.getSize() >= JOURNAL_CHECKPOINT_SIZE;
+	_journal_lock.unlock();
+
+	if (needs_checkpoint)
+		checkpoint();
+}
+
+bool ChunkArchive::checkpoint() {
+	// stores only wait while the pending chunks are copied and dropped,
+	// pending chunks only change while the journal lock is held, so they
+	// can be read without their lock
+	_checkpoint_lock.lock();
+	_journal_lock.lock();
+	std::vector<ArchiveJournal::Record> snapshot;
+	snapshot.reserve(_pending.size());
+	for (const auto &entry : _pending)
+		snapshot.push_back(entry.second);
+	_journal_lock.unlock();
+	if (snapshot.empty()) {
+		_checkpoint_lock.unlock();
+		return true;
+	}
+
+	// region by region, in directory order
+	std::vector<const ArchiveJournal::Record *> records;
+	for (const auto &record : snapshot)
+		records.push_back(&record);
+	auto getStorageOrder = [](vec3i64 cc) {
+		vec3i64 rc = getRegionCoords(cc);
+		return std::make_tuple(rc[2], rc[1], rc[0], cycle(cc[2], REGION_SIZE),
+				cycle(cc[1], REGION_SIZE), cycle(cc[0], REGION_SIZE));
+	};
+	std::sort(records.begin(), records.end(),
+			[&getStorageOrder](const ArchiveJournal::Record *a, const ArchiveJournal::Record *b) {
+				return getStorageOrder(a->cc) < getStorageOrder(b->cc);
+			});
+
+	bool success = true;
+	size_t i = 0;
+	while (i < records.size()) {
+		vec3i64 rc = getRegionCoords(records[i]->cc);
+		std::vector<const ArchiveJournal::Record *> region_records;
+		for (; i < records.size() && getRegionCoords(records[i]->cc) == rc; ++i)
+			region_records.push_back(records[i]);
+		Statistics change;
+		_file_map_lock.lockRead();
+		ArchiveFile *archive_file = unsafe_getArchiveFile(rc);
+		if (!archive_file->storeChunks(region_records, &_ring, &change))
+			success = false;
+		addStatistics(change);
+		// the journal may only be cleared once the chunks are on the disk
+		if (!archive_file->sync())
+			success = false;
+		_file_map_lock.unlockRead();
+	}
+
+	if (success) {
+		storeManifest();
+		// chunks that were stored again in the meantime stay pending
+		_journal_lock.lock();
+		_pending_lock.lockWrite();
+		for (const auto &record : snapshot) {
+			auto iter = _pending.find(record.cc);
+			if (iter != _pending.end() && iter->second.revision == record.revision)
+				_pending.erase(iter);
+		}
+		_pending_lock.unlockWrite();
+		if (_journal_good) {
+			if (_pending.empty()) {
+				_journal.clear();
+			} else {
+				std::vector<ArchiveJournal::Record> remaining;
+				for (const auto &entry : _pending)
+					remaining.push_back(entry.second);
+				_journal.rewrite(remaining);
+			}
+		}
+		_journal_lock.unlock();
+	} else {
+		LOG_ERROR(logger) << "Not all journaled chunks could be written, keeping the journal";
+	}
+	_checkpoint_lock.unlock();
+	return success;
+}
+
+int ChunkArchive::compactRegions(float min_fragmentation, int max_regions, Time min_idle,
+		bool scan_regions) {
+	// journaled chunks would only fragment the regions again
+	checkpoint();
+
+	using namespace boost::filesystem;
+	std::vector<std::pair<float, vec3i64>> candidates;
+	Time now = getCurrentTime();
+
 	_file_map_lock.lockRead();
-	ArchiveFile *archive_file = unsafe_getArchiveFile(chunk.getCC());
-	archive_file->storeChunk(chunk);
+	for (const auto &entry : _file_map) {
+		ArchiveFile *archive_file = entry.second.file;
+		float fragmentation = archive_file->getChunkFragmentation();
+		if (now - archive_file->getLastAccess() >= min_idle && fragmentation > min_fragmentation)
+			candidates.push_back({fragmentation, entry.first});
+	}
+	for (const auto &entry : _closed_regions) {
+		if (now - entry.second.last_access >= min_idle
+				&& entry.second.fragmentation > min_fragmentation)
+			candidates.push_back({entry.second.fragmentation, entry.first});
+	}
+
+	if (scan_regions) {
+		boost::system::error_code ec;
+		directory_iterator iter(_path, ec);
+		directory_iterator end;
+		for (; !ec && iter != end; iter.increment(ec)) {
+			const path &p = iter->path();
+			vec3i64 rc;
+			if (p.extension() != ".region" || sscanf(p.stem().string().c_str(),
+					"%" SCNd64 "_%" SCNd64 "_%" SCNd64, &rc[0], &rc[1], &rc[2]) != 3)
+				continue;
+			if (_file_map.find(rc) != _file_map.end()
+					|| _closed_regions.find(rc) != _closed_regions.end())
+				continue;
+
+			// regions are only created under the write lock, so the file
+			// can't be initialized while it is looked at
+			ArchiveFile af(p.string().c_str(), REGION_SIZE);
+			float fragmentation = af.getChunkFragmentation();
+			if (fragmentation > min_fragmentation)
+				candidates.push_back({fragmentation, rc});
+		}
+	}
 	_file_map_lock.unlockRead();
+
+	std::sort(candidates.begin(), candidates.end(),
+			[](const std::pair<float, vec3i64> &a, const std::pair<float, vec3i64> &b) {
+				return a.first > b.first;
+			});
+	if (max_regions >= 0 && candidates.size() > (size_t) max_regions)
+		candidates.resize(max_regions);
+
+	int num_compacted = 0;
+	for (const auto &candidate : candidates) {
+		ArchiveFile *archive_file = pinArchiveFile(candidate.second);
+		if (!archive_file)
+			continue;
+		// the region can't be closed while it is pinned, the file itself
+		// holds up its loads and stores, everyone else goes on
+		Statistics change;
+		if (archive_file->compact(&change))
+			++num_compacted;
+		unpinArchiveFile(candidate.second);
+		addStatistics(change);
+	}
+	storeManifest();
+	return num_compacted;
+}
+
+ChunkArchive::Statistics ChunkArchive::getStatistics() {
+	_statistics_lock.lock();
+	Statistics statistics = _statistics;
+	_statistics_lock.unlock();
+	return statistics;
+}
+
+bool ChunkArchive::loadManifest() {
+	std::ifstream file(_path + "archive.manifest", std::ios::binary);
+	Manifest manifest;
+	if (!file.read((char *) &manifest, sizeof(Manifest)))
+		return false;
+	if (memcmp(manifest.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0
+			|| manifest.endianess_bytes != ENDIANESS_BYTES
+			|| manifest.version != RECENT_MANIFEST_VERSION) {
+		LOG_WARNING(logger) << "Chunk archive '" << _path << "' had bad manifest";
+		return false;
+	}
+	_statistics.file_bytes = manifest.file_bytes;
+	_statistics.used_bytes = manifest.used_bytes;
+	_statistics.total_bytes = manifest.total_bytes;
+	return true;
+}
+
+void ChunkArchive::storeManifest() {
+	_statistics_lock.lock();
+	if (!_statistics_changed) {
+		_statistics_lock.unlock();
+		return;
+	}
+
+	Manifest manifest;
+	memcpy(manifest.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+	manifest.endianess_bytes = ENDIANESS_BYTES;
+	manifest.version = RECENT_MANIFEST_VERSION;
+	manifest.file_bytes = _statistics.file_bytes;
+	manifest.used_bytes = _statistics.used_bytes;
+	manifest.total_bytes = _statistics.total_bytes;
+
+	// the manifest is replaced as a whole, a torn one is rejected and
+	// the regions are scanned again, after a crash it may miss what the
+	// last checkpoint changed
+	std::string filename = _path + "archive.manifest";
+	std::string new_filename = filename + ".new";
+	std::ofstream file(new_filename, std::ios::binary | std::ios::trunc);
+	bool success = (bool) file.write((const char *) &manifest, sizeof(Manifest));
+	file.close();
+	boost::system::error_code ec;
+	if (success)
+		boost::filesystem::rename(new_filename, filename, ec);
+	if (!success || ec)
+		LOG_WARNING(logger) << "Could not store manifest of chunk archive '" << _path << "'";
+	else
+		_statistics_changed = false;
+	_statistics_lock.unlock();
+}
+
+void ChunkArchive::addStatistics(const Statistics &change) {
+	if (change.file_bytes == 0 && change.used_bytes == 0 && change.total_bytes == 0)
+		return;
+	_statistics_lock.lock();
+	_statistics.file_bytes += change.file_bytes;
+	_statistics.used_bytes += change.used_bytes;
+	_statistics.total_bytes += change.total_bytes;
+	_statistics_changed = true;
+	_statistics_lock.unlock();
 }
 
 void ChunkArchive::clean(Time t) {
@@ -507,56 +1277,154 @@ void ChunkArchive::clean(Time t) {
 	_file_map_lock.unlockWrite();
 }
 
-// the caller of this function needs to hold a read-lock
-ArchiveFile *ChunkArchive::unsafe_getArchiveFile(vec3i64 cc) {
+size_t ChunkArchive::getNumOpenRegions() {
+	_file_map_lock.lockRead();
+	size_t num_open = _file_map.size();
+	_file_map_lock.unlockRead();
+	return num_open;
+}
+
+vec3i64 ChunkArchive::getRegionCoords(vec3i64 cc) {
 	vec3i64 rc;
 	rc[0] = cc[0] / REGION_SIZE - (cc[0] < 0 ? 1 : 0);
 	rc[1] = cc[1] / REGION_SIZE - (cc[1] < 0 ? 1 : 0);
 	rc[2] = cc[2] / REGION_SIZE - (cc[2] < 0 ? 1 : 0);
+	return rc;
+}
 
+std::string ChunkArchive::getRegionFilename(vec3i64 rc) const {
+	char buffer[200];
+	sprintf(buffer, "%" PRId64 "_%" PRId64 "_%" PRId64 ".region",
+			rc[0], rc[1], rc[2]);
+	return _path + std::string(buffer);
+}
+
+// the caller of this function needs to hold a read-lock
+ArchiveFile *ChunkArchive::unsafe_getArchiveFile(vec3i64 rc, bool create) {
 	auto iter = _file_map.find(rc);
 	while (iter == _file_map.end()) {
+		if (!create && _missing_regions.find(rc) != _missing_regions.end())
+			return nullptr;
+
 		_file_map_lock.unlockRead();
 		_file_map_lock.lockWrite();
 
+		std::vector<ArchiveFile *> evicted;
+		bool exists = true;
 		iter = _file_map.find(rc);
-		if (iter == _file_map.end()) {
-			unsafe_addArchiveFile(rc);
-		}
+		if (iter == _file_map.end())
+			exists = unsafe_addArchiveFile(rc, create, &evicted);
 
 		_file_map_lock.unlockWrite();
+		// nobody can reach the evicted files anymore, so they can be
+		// closed without holding up everyone else
+		for (ArchiveFile *archive_file : evicted)
+			delete archive_file;
 		_file_map_lock.lockRead();
+		if (!exists)
+			return nullptr;
+		iter = _file_map.find(rc);
+	}
+
+	_lru_lock.lock();
+	_lru.splice(_lru.begin(), _lru, iter->second.lru_iter);
+	_lru_lock.unlock();
+	return iter->second.file;
+}
+
+ArchiveFile *ChunkArchive::pinArchiveFile(vec3i64 rc) {
+	std::vector<ArchiveFile *> evicted;
+	ArchiveFile *archive_file = nullptr;
+	_file_map_lock.lockWrite();
+	auto iter = _file_map.find(rc);
+	if (iter == _file_map.end() && unsafe_addArchiveFile(rc, false, &evicted))
 		iter = _file_map.find(rc);
+	if (iter != _file_map.end()) {
+		iter->second.pinned = true;
+		archive_file = iter->second.file;
 	}
+	_file_map_lock.unlockWrite();
+	for (ArchiveFile *evicted_file : evicted)
+		delete evicted_file;
+	return archive_file;
+}
 
-	return iter->second;
+void ChunkArchive::unpinArchiveFile(vec3i64 rc) {
+	_file_map_lock.lockWrite();
+	auto iter = _file_map.find(rc);
+	if (iter != _file_map.end())
+		iter->second.pinned = false;
+	_file_map_lock.unlockWrite();
 }
 
 // the caller of this function needs to hold a write-lock
-void ChunkArchive::unsafe_addArchiveFile(vec3i64 rc) {
-	unsafe_clean(seconds(10));
-	char buffer[200];
-	sprintf(buffer, "%" PRId64 "_%" PRId64 "_%" PRId64 ".region",
-			rc[0], rc[1], rc[2]);
-	std::string filename = _path + std::string(buffer);
-	ArchiveFile *archive_file = new ArchiveFile(filename.c_str(), REGION_SIZE);
-	_file_map.insert({rc, archive_file});
+bool ChunkArchive::unsafe_addArchiveFile(vec3i64 rc, bool create,
+		std::vector<ArchiveFile *> *evicted) {
+	std::string filename = getRegionFilename(rc);
+	if (create) {
+		_missing_regions.erase(rc);
+	} else {
+		if (_missing_regions.find(rc) != _missing_regions.end())
+			return false;
+		boost::system::error_code ec;
+		if (!boost::filesystem::exists(filename, ec)) {
+			// forgetting what we know is cheaper than letting it grow
+			if (_missing_regions.size() >= MAX_MISSING_REGIONS)
+				_missing_regions.clear();
+			_missing_regions.insert(rc);
+			return false;
+		}
+	}
+
+	// pinned regions stay open, even if that means one region too many
+	auto lru_iter = _lru.end();
+	while (_file_map.size() >= _max_open_regions && lru_iter != _lru.begin()) {
+		--lru_iter;
+		auto iter = _file_map.find(*lru_iter);
+		if (iter->second.pinned)
+			continue;
+		unsafe_closeArchiveFile(iter);
+		evicted->push_back(iter->second.file);
+		_file_map.erase(iter);
+		lru_iter = _lru.erase(lru_iter);
+	}
+
+	ArchiveFile *archive_file = new ArchiveFile(filename.c_str(), REGION_SIZE, _compression,
+			_generator.get());
+	if (archive_file->wasCreated())
+		addStatistics(archive_file->getStatistics());
+	_closed_regions.erase(rc);
+	_lru.push_front(rc);
+	_file_map.insert({rc, OpenRegion{archive_file, _lru.begin(), false}});
+	return true;
+}
+
+// the caller of this function needs to hold a write lock
+void ChunkArchive::unsafe_closeArchiveFile(FileMap::iterator iter) {
+	// what compaction needs to know about the region outlives the file
+	ArchiveFile *archive_file = iter->second.file;
+	_closed_regions[iter->first] = ClosedRegion{archive_file->getChunkFragmentation(),
+			archive_file->getLastAccess()};
 }
 
 // the caller of this function needs to hold a write lock
 void ChunkArchive::unsafe_clean(Time t) {
+	// the least recently used regions are the ones that were idle longest
 	int num_cleaned = 0;
 	Time now = getCurrentTime();
-	auto iter = _file_map.begin();
-	while (iter != _file_map.end()) {
-		bool should_delete = now - iter->second->getLastAccess() > t;
-		if (should_delete) {
-			delete iter->second;
-			iter = _file_map.erase(iter);
-			++num_cleaned;
-		} else {
-			++iter;
-		}
+	auto lru_iter = _lru.end();
+	while (lru_iter != _lru.begin()) {
+		--lru_iter;
+		auto iter = _file_map.find(*lru_iter);
+		if (iter->second.pinned)
+			continue;
+		if (now - iter->second.file->getLastAccess() <= t)
+			break;
+		unsafe_closeArchiveFile(iter);
+		delete iter->second.file;
+		_file_map.erase(iter);
+		lru_iter = _lru.erase(lru_iter);
+		++num_cleaned;
 	}
 	if (num_cleaned)
 		LOG_DEBUG(logger) << "Cleaned " << num_cleaned << " file handles";
@@ -2,22 +2,59 @@
 #define CHUNK_ARCHIVE_HPP_
 
 #include <fstream>
+#include <list>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "engine/vmath.hpp"
 #include "engine/macros.hpp"
 #include "engine/time.hpp"
 #include "engine/rwlock.hpp"
+#include "engine/mutex.hpp"
+#include "engine/io_ring.hpp"
 
 #include "game/chunk.hpp"
+#include "game/world_generator.hpp"
+
+#include "archive_journal.hpp"
 
 class ArchiveFile;
 
+/** How newly stored chunks are compressed
+
+	Chunks are run length encoded, ZLIB deflates the result.  DIFF stores only the blocks that
+	differ from what the world generator makes of the chunk, deflated as well, and falls back
+	to ZLIB for chunks where that doesn't pay off.  Any archive can read chunks stored with
+	any of them, but DIFF chunks need the world generator of the world.
+*/
+enum class ArchiveCompression {
+	RLE,
+	ZLIB,
+	DIFF,
+};
+
 class ChunkArchive {
 public:
+	/** How much space the region files take
+
+		The statistics are kept up to date as chunks are stored and regions are compacted, and
+		saved in the archive's manifest, so opening an archive doesn't have to look at every
+		region file.  Only if the manifest is missing are the region files scanned.
+	*/
+	struct Statistics {
+		int64 file_bytes = 0;
+		// bytes of the chunk heaps that hold chunks, and that the heaps span
+		int64 used_bytes = 0;
+		int64 total_bytes = 0;
+	};
+
 	~ChunkArchive();
-	ChunkArchive(const char *);
+	// at most max_open_regions region files are kept open at a time
+	ChunkArchive(const char *, ArchiveCompression = ArchiveCompression::ZLIB,
+			std::unique_ptr<WorldGenerator> = nullptr, size_t max_open_regions = 256);
 
 	ChunkArchive() = delete;
 	ChunkArchive(const ChunkArchive &) = delete;
@@ -29,37 +66,130 @@ public:
 	/** Check whether a chunk was stored in the past
 
 		If a chunk exists and revision is not nullptr, the current revision of the chunk is written
-		to the address pointed to by revision.
-
-		Calling any number of instances of this function and up to one instance of either
-		loadChunk or storeChunk concurrently is safe.
+		to the address pointed to by revision.  Neither this nor loading creates region files,
+		regions that don't exist are remembered, so asking again doesn't touch the disk.
 	*/
 	bool hasChunk(vec3i64, uint32 *revision = nullptr);
 
 	/** Load and store chunks
 
-		Calling any number of instances of hasChunk concurrently to these functions is safe.  
-		However, calling more than one instance of either loadChunk or storeChunk concurrently
-		is NOT safe.  Only one thread should ever make calls to these functions.
+		Any number of threads may load and store chunks concurrently.  Every region file has its
+		own locks, so only stores to the same region wait for each other, and loads only wait
+		while a chunk is being written to their region.  Chunks are encoded and decoded outside
+		of any lock.  Stores and loads of the same chunk happen in no particular order though, a
+		caller that needs one to see the other has to wait for it.
+
+		Stored chunks are appended to the archive's journal and are safe once the call returns.
+		storeChunks commits all of its chunks with a single write.  They only make it into the
+		region files at the next checkpoint, until then they are loaded from memory.
+
+		Chunks stored as differences are regenerated with the archive's own world generator.
+
+		loadChunks groups the chunks by region and reads each region in the order its chunks
+		are stored in, neighboring chunks with a single large read.  The reads of a region go to
+		the given ring in one batch, the ring belongs to the calling thread.  Without a ring
+		they are copied out of the mapping.  Chunks that can't be loaded are left uninitialized,
+		the number of loaded chunks is returned.
 	*/
 	bool loadChunk(Chunk *);
+	int loadChunks(const std::vector<Chunk *> &, IORing *ring = nullptr);
 	void storeChunk(const Chunk &);
+	void storeChunks(const std::vector<const Chunk *> &);
+
+	/** Writes the journaled chunks to their region files and clears the journal
+
+		This happens by itself whenever the journal grows large, when the archive is opened
+		and when it is destroyed.  If not all chunks could be written, the journal is kept and
+		false is returned.  The chunks are written without holding up stores, chunks that are
+		stored meanwhile stay in the journal until the next checkpoint.  Loads don't wait.
+	*/
+	bool checkpoint();
 
 	/** Closes all file handles that were not used recently
 
 		E.g. clean(seconds(1)) closes all handles that were not accessed for more than one second
-		and clean() closes all file handles.
+		and clean() closes all file handles.  Handles are closed anyway once there are too many
+		of them, the least recently used ones first.
 	*/
 	void clean(Time t = 0);
+	size_t getNumOpenRegions();
+
+	/** Rewrites fragmented region files without holes
+
+		Only regions with more than min_fragmentation of their chunk heap unused, that were not
+		accessed for min_idle, are compacted, the most fragmented ones first and at most
+		max_regions of them (all of them if max_regions is negative).  Returns the number of
+		compacted regions.  Loads and stores wait for the region that is being compacted.
+
+		Only regions that were opened since the archive was opened are considered, their
+		fragmentation is remembered when they are closed.  With scan_regions every region file
+		of the archive is looked at.
+	*/
+	int compactRegions(float min_fragmentation = 0.0f, int max_regions = -1, Time min_idle = 0,
+			bool scan_regions = false);
+
+	Statistics getStatistics();
 
 private:
-	ArchiveFile *unsafe_getArchiveFile(vec3i64);
-	void unsafe_addArchiveFile(vec3i64);
+	static vec3i64 getRegionCoords(vec3i64 cc);
+	std::string getRegionFilename(vec3i64 rc) const;
+
+	bool loadManifest();
+	void storeManifest();
+	void addStatistics(const Statistics &);
+
+	// returns nullptr if the region doesn't exist and create is false
+	ArchiveFile *unsafe_getArchiveFile(vec3i64, bool create = true);
+	bool unsafe_addArchiveFile(vec3i64, bool create, std::vector<ArchiveFile *> *evicted);
 	void unsafe_clean(Time t = 0);
+	// pinned regions are not closed, returns nullptr if the region doesn't exist
+	ArchiveFile *pinArchiveFile(vec3i64);
+	void unpinArchiveFile(vec3i64);
 
 	std::string _path;
-	std::unordered_map<vec3i64, ArchiveFile *, size_t(*)(vec3i64)> _file_map;
+	ArchiveCompression _compression;
+	std::unique_ptr<WorldGenerator> _generator;
+	struct OpenRegion {
+		ArchiveFile *file;
+		std::list<vec3i64>::iterator lru_iter;
+		// pins only change under the write lock of the file map
+		bool pinned;
+	};
+	typedef std::unordered_map<vec3i64, OpenRegion, size_t(*)(vec3i64)> FileMap;
+	void unsafe_closeArchiveFile(FileMap::iterator);
+	FileMap _file_map;
 	ReadWriteLock _file_map_lock;
+	// open regions, the most recently used first, readers of the file
+	// map reorder it under the lru lock
+	std::list<vec3i64> _lru;
+	Mutex _lru_lock;
+	const size_t _max_open_regions;
+	// regions that have no file yet, they only change under the write
+	// lock of the file map
+	std::unordered_set<vec3i64, size_t(*)(vec3i64)> _missing_regions;
+	struct ClosedRegion {
+		float fragmentation;
+		Time last_access;
+	};
+	// regions that were open before, they only change under the write lock
+	// of the file map
+	std::unordered_map<vec3i64, ClosedRegion, size_t(*)(vec3i64)> _closed_regions;
+
+	ArchiveJournal _journal;
+	bool _journal_good = false;
+	Mutex _journal_lock;
+	// only one checkpoint runs at a time
+	Mutex _checkpoint_lock;
+	// the checkpoint writes the chunks of a region in one batch
+	IORing _ring;
+	// chunks that are in the journal, but not in their region files yet
+	std::unordered_map<vec3i64, ArchiveJournal::Record, size_t(*)(vec3i64)> _pending;
+	ReadWriteLock _pending_lock;
+
+	Statistics _statistics;
+	// whether the statistics changed since the manifest was stored
+	bool _statistics_changed = false;
+	Mutex _statistics_lock;
 };
 
 #endif // CHUNK_ARCHIVE_HPP_
@@ -0,0 +1,53 @@
+#include "chunk_cache.hpp"
+
+#include "shared/game/chunk.hpp"
+
+ChunkCache::ChunkCache(size_t capacity) :
+	capacity(capacity),
+	chunks(0, vec3i64HashFunc)
+{
+	// nothing
+}
+
+Chunk *ChunkCache::insert(Chunk *chunk) {
+	if (capacity == 0)
+		return chunk;
+
+	auto it = chunks.find(chunk->getCC());
+	if (it != chunks.end()) {
+		// only the newest revision is worth keeping
+		Chunk *cached = *it->second;
+		if (cached->getRevision() > chunk->getRevision())
+			return chunk;
+		order.erase(it->second);
+		order.push_front(chunk);
+		it->second = order.begin();
+		return cached;
+	}
+
+	Chunk *evicted = nullptr;
+	if (chunks.size() >= capacity)
+		evicted = evict();
+	order.push_front(chunk);
+	chunks.insert({chunk->getCC(), order.begin()});
+	return evicted;
+}
+
+Chunk *ChunkCache::take(vec3i64 chunkCoords) {
+	auto it = chunks.find(chunkCoords);
+	if (it == chunks.end())
+		return nullptr;
+	Chunk *chunk = *it->second;
+	order.erase(it->second);
+	chunks.erase(it);
+	return chunk;
+}
+
+Chunk *ChunkCache::evict() {
+	if (order.empty())
+		return nullptr;
+	Chunk *chunk = order.back();
+	order.pop_back();
+	chunks.erase(chunk->getCC());
+	return chunk;
+}
@@ -0,0 +1,45 @@
+#ifndef CHUNK_CACHE_HPP_
+#define CHUNK_CACHE_HPP_
+
+#include <list>
+#include <unordered_map>
+
+#include "shared/engine/std_types.hpp"
+#include "shared/engine/vmath.hpp"
+#include "shared/block_utils.hpp"
+
+class Chunk;
+
+/** Decoded chunks that nobody needs right now, but that might be needed again soon
+
+	The cache only holds chunks that are the same as what the archive has, so they can be
+	handed out again instead of being loaded or generated.  It doesn't own its chunks, whatever
+	is displaced or evicted goes back to the caller.  Once the cache is full, the chunk that
+	was inserted least recently makes room.
+*/
+class ChunkCache {
+public:
+	ChunkCache(size_t capacity);
+
+	ChunkCache(const ChunkCache &) = delete;
+	ChunkCache &operator = (const ChunkCache &) = delete;
+
+	// returns a chunk that doesn't fit anymore, either an older revision
+	// of the same chunk or the least recently inserted one, or nullptr
+	Chunk *insert(Chunk *);
+	// removes the chunk from the cache, nullptr if it isn't cached
+	Chunk *take(vec3i64 chunkCoords);
+	// removes the least recently inserted chunk, nullptr if the cache is empty
+	Chunk *evict();
+
+	size_t size() const { return chunks.size(); }
+	size_t getCapacity() const { return capacity; }
+
+private:
+	const size_t capacity;
+	// the most recently inserted chunk first
+	std::list<Chunk *> order;
+	std::unordered_map<vec3i64, std::list<Chunk *>::iterator, size_t(*)(vec3i64)> chunks;
+};
+
+#endif // CHUNK_CACHE_HPP_
@@ -1,190 +1,293 @@
 #include "chunk_compression.hpp"
 
+#include <algorithm>
 #include <cstring>
 
+#include <zlib.h>
+
 #include "shared/game/chunk.hpp"
 
 #include "shared/engine/logging.hpp"
 
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define RLE_VECTOR_WIDTH 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define RLE_VECTOR_WIDTH 16
+#else
+	#define RLE_VECTOR_WIDTH 0
+#endif
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
 static logging::Logger logger("io");
 
 static const uint8 ESCAPE_CHAR = (uint8) (-1);
+// longest run a single escape sequence can hold
+static const size_t MAX_RUN_LENGTH = 0x8000;
+// bytes read from an istream at once while decoding
+static const size_t STREAM_BUFFER_SIZE = 4096;
+static const int ZLIB_LEVEL = 6;
 
-void decodeBlocks_RLE(std::istream *is, uint8 *blocks) {
-	size_t index = 0;
-	while (index < Chunk::SIZE) {
-		uint8 next_block;
-		if (!is->good()) {
-			LOG_ERROR(logger) << "encoded stream ended abruptly";
-			return;
-		}
-		is->read((char *) &next_block, sizeof (uint8));
-
-		if (next_block == ESCAPE_CHAR) {
-			uint8 next_byte, block_type;
-			uint32 run_length;
-			if (!is->good()) {
-				LOG_ERROR(logger) << "encoded stream ended abruptly";
-				return;
-			}
-			is->read((char *) &next_byte, sizeof (uint8));
-
-			// Like UTF8, the first bit signals a multi-byte sequence
-			if ((next_byte & 0x80) == 0) {
-				// This is the only byte
-				run_length = next_byte;
-			} else {
-				// There is exactly one extra byte, the other 7 bits can be used for the value
-				uint32 encoded_run_length = next_byte & 0x7F;
-				if (!is->good()) {
-					LOG_ERROR(logger) << "encoded stream ended abruptly";
-					return;
-				}
-				is->read((char *) &next_byte, sizeof (uint8));
-				encoded_run_length = (encoded_run_length << 8) | next_byte;
-				// we count from 1 and not from 0 to save space
-				run_length = encoded_run_length + 1;
-			}
-
-			if (!is->good()) {
-				LOG_ERROR(logger) << "encoded stream ended abruptly";
-				return;
-			}
-			is->read((char *) &block_type, sizeof (uint8));
-			for (uint32 i = 0; i < run_length; ++i) {
-				if (index >= Chunk::SIZE) {
-					LOG_ERROR(logger) << "Block data exceeded Chunk size";
-					break;
-				}
-				blocks[index++] = block_type;
-			}
-		} else {
-			blocks[index++] = next_block;
-		}
+#if RLE_VECTOR_WIDTH > 0
+static uint countTrailingZeros(uint32 x) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return (uint) index;
+#else
+	return (uint) __builtin_ctz(x);
+#endif
+}
+#endif
+
+// returns the first index in [i, end) where (data[index] == value) equals
+// MATCH, or end if there is none
+template <bool MATCH>
+static size_t scanBytes(const uint8 *data, size_t i, size_t end, uint8 value) {
+#if RLE_VECTOR_WIDTH == 32
+	const __m256i values = _mm256_set1_epi8((char) value);
+	for (; i + 32 <= end; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (data + i));
+		uint32 mask = (uint32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, values));
+		if (!MATCH)
+			mask = ~mask;
+		if (mask != 0)
+			return i + countTrailingZeros(mask);
 	}
+#elif RLE_VECTOR_WIDTH == 16
+	const __m128i values = _mm_set1_epi8((char) value);
+	for (; i + 16 <= end; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+		uint32 mask = (uint32) _mm_movemask_epi8(_mm_cmpeq_epi8(v, values));
+		if (!MATCH)
+			mask ^= 0xFFFF;
+		if (mask != 0)
+			return i + countTrailingZeros(mask);
+	}
+#endif
+	while (i < end && (data[i] == value) != MATCH)
+		++i;
+	return i;
 }
 
-void decodeBlocks_RLE(const uint8 *encoded, size_t size, uint8 *blocks) {
+static size_t findByte(const uint8 *data, size_t i, size_t end, uint8 value) {
+	return scanBytes<true>(data, i, end, value);
+}
+
+static size_t skipByte(const uint8 *data, size_t i, size_t end, uint8 value) {
+	return scanBytes<false>(data, i, end, value);
+}
+
+// returns the first index in [i, end) where a and b differ, or end if
+// there is none
+static size_t findMismatch(const uint8 *a, const uint8 *b, size_t i, size_t end) {
+#if RLE_VECTOR_WIDTH == 32
+	for (; i + 32 <= end; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+		uint32 mask = ~(uint32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+		if (mask != 0)
+			return i + countTrailingZeros(mask);
+	}
+#elif RLE_VECTOR_WIDTH == 16
+	for (; i + 16 <= end; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+		uint32 mask = (uint32) _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFF;
+		if (mask != 0)
+			return i + countTrailingZeros(mask);
+	}
+#endif
+	while (i < end && a[i] == b[i])
+		++i;
+	return i;
+}
+
+namespace {
+
+class MemorySource {
+public:
+	MemorySource(const uint8 *data, size_t size) :
+		pos(data), end(data + size) {}
+
+	// makes sure at least n bytes are available
+	bool fill(size_t n) { return (size_t) (end - pos) >= n; }
+	void finish() {}
+
+	const uint8 *pos;
+	const uint8 *end;
+};
+
+// Reads the stream in blocks instead of byte by byte, whatever was read
+// past the end of the encoded data is given back when done.
+class StreamSource {
+public:
+	StreamSource(std::istream *is) :
+		pos(buffer), end(buffer), is(is) {}
+
+	bool fill(size_t n) {
+		size_t available = end - pos;
+		if (available >= n)
+			return true;
+		memmove(buffer, pos, available);
+		pos = buffer;
+		end = buffer + available;
+		is->read((char *) end, STREAM_BUFFER_SIZE - available);
+		end += is->gcount();
+		if ((size_t) (end - pos) < n)
+			return false;
+		// a short read at the end of the stream is fine as long as
+		// we got what we needed
+		is->clear();
+		return true;
+	}
+
+	void finish() {
+		is->clear();
+		if (pos != end)
+			is->seekg(-(std::streamoff) (end - pos), std::ios_base::cur);
+	}
+
+	const uint8 *pos;
+	const uint8 *end;
+
+private:
+	std::istream *is;
+	uint8 buffer[STREAM_BUFFER_SIZE];
+};
+
+} // namespace
+
+template <typename Source>
+static bool decodeRuns(Source *source, uint8 *blocks) {
 	size_t index = 0;
 	while (index < Chunk::SIZE) {
-		uint8 next_block;
-		if (size < 1) {
+		if (!source->fill(1)) {
 			LOG_ERROR(logger) << "encoded stream ended abruptly";
-			return;
+			return false;
 		}
-		next_block = *encoded;
-		encoded++;
-		size--;
-
-		if (next_block == ESCAPE_CHAR) {
-			uint8 next_byte, block_type;
-			uint32 run_length;
-			if (size < 1) {
-				LOG_ERROR(logger) << "encoded stream ended abruptly";
-				return;
-			}
-			next_byte = *encoded;
-			encoded++;
-			size--;
-
-			// Like UTF8, the first bit signals a multi-byte sequence
-			if ((next_byte & 0x80) == 0) {
-				// This is the only byte
-				run_length = next_byte;
-			} else {
-				// There is exactly one extra byte, the other 7 bits can be used for the value
-				uint32 encoded_run_length = next_byte & 0x7F;
-				if (size < 1) {
-					LOG_ERROR(logger) << "encoded stream ended abruptly";
-					return;
-				}
-				next_byte = *encoded;
-				encoded++;
-				size--;
-				encoded_run_length = (encoded_run_length << 8) | next_byte;
-				// we count from 1 and not from 0 to save space
-				run_length = encoded_run_length + 1;
-			}
-
-			if (size < 1) {
-				LOG_ERROR(logger) << "encoded stream ended abruptly";
-				return;
-			}
-			block_type = *encoded;
-			encoded++;
-			size--;
-			for (uint32 i = 0; i < run_length; ++i) {
-				if (index >= Chunk::SIZE) {
-					LOG_ERROR(logger) << "Block data exceeded Chunk size";
-					break;
-				}
-				blocks[index++] = block_type;
-			}
+
+		// everything up to the next escape character is copied as is
+		size_t available = std::min((size_t) (source->end - source->pos), Chunk::SIZE - index);
+		size_t literals = findByte(source->pos, 0, available, ESCAPE_CHAR);
+		memcpy(blocks + index, source->pos, literals);
+		index += literals;
+		source->pos += literals;
+		if (literals == available)
+			continue;
+
+		// Like UTF8, the first bit signals a multi-byte sequence
+		if (!source->fill(3) || ((source->pos[1] & 0x80) != 0 && !source->fill(4))) {
+			LOG_ERROR(logger) << "encoded stream ended abruptly";
+			return false;
+		}
+		const uint8 *escape = source->pos;
+		uint32 run_length;
+		uint8 block_type;
+		if ((escape[1] & 0x80) == 0) {
+			run_length = escape[1];
+			block_type = escape[2];
+			source->pos += 3;
 		} else {
-			blocks[index++] = next_block;
+			// we count from 1 and not from 0 to save space
+			run_length = (((escape[1] & 0x7F) << 8) | escape[2]) + 1;
+			block_type = escape[3];
+			source->pos += 4;
 		}
+
+		if (run_length > Chunk::SIZE - index) {
+			LOG_ERROR(logger) << "Block data exceeded Chunk size";
+			run_length = (uint32) (Chunk::SIZE - index);
+		}
+		memset(blocks + index, block_type, run_length);
+		index += run_length;
 	}
+	source->finish();
+	return true;
+}
+
+void decodeBlocks_RLE(std::istream *is, uint8 *blocks) {
+	StreamSource source(is);
+	decodeRuns(&source, blocks);
+}
+
+bool decodeBlocks_RLE(const uint8 *encoded, size_t size, uint8 *blocks) {
+	MemorySource source(encoded, size);
+	return decodeRuns(&source, blocks);
+}
+
+// Literal runs are encoded as themselves, so a span of them is copied in
+// one go. If it doesn't fit, only the runs that fit completely are written.
+static bool encodeLiterals(const uint8 *span, size_t length, uint8 **head, const uint8 *end) {
+	size_t available = end - *head;
+	bool fits = length <= available;
+	if (!fits) {
+		length = available;
+		while (length > 0 && span[length] == span[length - 1])
+			--length;
+	}
+	memcpy(*head, span, length);
+	*head += length;
+	return fits;
+}
+
+static bool encodeRun(uint8 type, size_t length, uint8 **head, const uint8 *end) {
+	if (length < 0x80) {
+		if (end - *head < 3)
+			return false;
+		(*head)[0] = ESCAPE_CHAR;
+		(*head)[1] = (uint8) length;
+		(*head)[2] = type;
+		*head += 3;
+	} else {
+		if (end - *head < 4)
+			return false;
+		// we count from 1 and not from 0 to save space
+		size_t encoded_run_length = length - 1;
+		(*head)[0] = ESCAPE_CHAR;
+		(*head)[1] = (uint8) ((encoded_run_length >> 8) | 0x80);
+		(*head)[2] = (uint8) (encoded_run_length & 0xFF);
+		(*head)[3] = type;
+		*head += 4;
+	}
+	return true;
 }
 
 int encodeBlocks_RLE(const uint8 *blocks, uint8 *buffer, size_t size) {
-	uint8 cur_run_type = blocks[0];
-	size_t cur_run_length = 1;
 	uint8 *head = buffer;
+	const uint8 *end = buffer + size;
+	size_t literal_start = 0;
+	size_t i = 0;
+	while (i < size) {
+		uint8 type = blocks[i];
+		size_t run_start = i;
+		i = skipByte(blocks, i + 1, size, type);
+		size_t run_length = i - run_start;
+		if (run_length <= 3 && type != ESCAPE_CHAR)
+			continue;
 
-	auto finishRun = [&]() -> int {
-		if (cur_run_length == 0)
-			return 0;
-		if (cur_run_length > 3 || cur_run_type == ESCAPE_CHAR) {
-			if (cur_run_length < 0x80) {
-				if ((uint) (head - buffer) + 3u <= size) {
-					*head++ = ESCAPE_CHAR;
-					*head++ = cur_run_length & 0xFF;
-					*head++ = cur_run_type;
-				} else {
-					return -1;
-				}
-			} else {
-				// we count from 1 and not from 0 to save space
-				size_t encoded_run_length = cur_run_length - 1;
-				if ((uint) (head - buffer) + 4u <= size) {
-					*head++ = ESCAPE_CHAR;
-					*head++ = (encoded_run_length >> 8) & 0xFF | 0x80;
-					*head++ = encoded_run_length & 0xFF;
-					*head++ = cur_run_type;
-				} else {
-					return -1;
-				}
-			}
-		} else {
-			if (head - buffer + cur_run_length <= size) {
-				for (size_t j = 0; j < cur_run_length; ++j)
-					*head++ = cur_run_type;
-			} else {
-				return -1;
-			}
-		}
-		return 0;
-	};
-
-	for (size_t i = 1; i < size; ++i) {
-		uint8 next_block = blocks[i];
-		if (cur_run_length >= 0x8000) {
-			if (finishRun() != 0)
-				return (int)(head - buffer);
-			cur_run_length = 0;
+		if (!encodeLiterals(blocks + literal_start, run_start - literal_start, &head, end))
+			return (int) (head - buffer);
+		for (; run_length > MAX_RUN_LENGTH; run_length -= MAX_RUN_LENGTH) {
+			if (!encodeRun(type, MAX_RUN_LENGTH, &head, end))
+				return (int) (head - buffer);
 		}
-		if (cur_run_type == next_block) {
-			cur_run_length++;
+		// a short remainder of a split run is a literal run again
+		if (run_length > 3 || type == ESCAPE_CHAR) {
+			if (!encodeRun(type, run_length, &head, end))
+				return (int) (head - buffer);
+			literal_start = i;
 		} else {
-			if (finishRun() != 0)
-				return (int)(head - buffer);
-			cur_run_type = next_block;
-			cur_run_length = 1;
+			literal_start = i - run_length;
 		}
 	}
 
-	finishRun();
-	return (int)(head - buffer);
+	encodeLiterals(blocks + literal_start, size - literal_start, &head, end);
+	return (int) (head - buffer);
 }
 
 void decodeBlocks_PLAIN(std::istream *is, uint8 *blocks) {
@@ -196,3 +299,79 @@ int encodeBlocks_PLAIN(const uint8 *blocks, uint8 *buffer, size_t size) {
 	memcpy(buffer, blocks, actual_size);
 	return (int) actual_size;
 }
+
+int decodeBlocks_ZLIB(const uint8 *deflated, size_t size, uint8 *buffer, size_t capacity) {
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit(&stream) != Z_OK) {
+		LOG_ERROR(logger) << "zlib could not be initialized";
+		return -1;
+	}
+	stream.next_in = (Bytef *) deflated;
+	stream.avail_in = (uInt) size;
+	stream.next_out = buffer;
+	stream.avail_out = (uInt) capacity;
+	// whatever follows the end of the zlib stream is padding
+	int result = inflate(&stream, Z_FINISH);
+	int bytes = (int) stream.total_out;
+	inflateEnd(&stream);
+	if (result != Z_STREAM_END) {
+		LOG_ERROR(logger) << "deflated stream was corrupt (" << result << ")";
+		return -1;
+	}
+	return bytes;
+}
+
+int encodeBlocks_ZLIB(const uint8 *encoded, size_t size, uint8 *buffer, size_t capacity) {
+	uLongf bytes = (uLongf) capacity;
+	if (compress2(buffer, &bytes, encoded, (uLong) size, ZLIB_LEVEL) != Z_OK)
+		return -1;
+	return (int) bytes;
+}
+
+bool decodeBlocks_DIFF(const uint8 *encoded, size_t size, const uint8 *base, uint8 *blocks) {
+	if (size < 2) {
+		LOG_ERROR(logger) << "encoded stream ended abruptly";
+		return false;
+	}
+	size_t num_diffs = encoded[0] | (encoded[1] << 8);
+	if (size < 2 + 3 * num_diffs) {
+		LOG_ERROR(logger) << "encoded stream ended abruptly";
+		return false;
+	}
+
+	if (blocks != base)
+		memcpy(blocks, base, Chunk::SIZE);
+	const uint8 *diff = encoded + 2;
+	for (size_t i = 0; i < num_diffs; ++i, diff += 3) {
+		size_t index = diff[0] | (diff[1] << 8);
+		if (index >= Chunk::SIZE) {
+			LOG_ERROR(logger) << "Block data exceeded Chunk size";
+			return false;
+		}
+		blocks[index] = diff[2];
+	}
+	return true;
+}
+
+int encodeBlocks_DIFF(const uint8 *blocks, const uint8 *base, uint8 *buffer, size_t size) {
+	if (size < 2)
+		return -1;
+	uint8 *head = buffer + 2;
+	const uint8 *end = buffer + size;
+	size_t num_diffs = 0;
+	size_t index = findMismatch(blocks, base, 0, Chunk::SIZE);
+	while (index < Chunk::SIZE) {
+		if (end - head < 3)
+			return -1;
+		head[0] = (uint8) (index & 0xFF);
+		head[1] = (uint8) (index >> 8);
+		head[2] = blocks[index];
+		head += 3;
+		++num_diffs;
+		index = findMismatch(blocks, base, index + 1, Chunk::SIZE);
+	}
+	buffer[0] = (uint8) (num_diffs & 0xFF);
+	buffer[1] = (uint8) (num_diffs >> 8);
+	return (int) (head - buffer);
+}
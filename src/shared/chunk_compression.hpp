@@ -6,9 +6,20 @@
 #include "shared/engine/std_types.hpp"
 
 void decodeBlocks_RLE(std::istream *is, uint8 *blocks);
-void decodeBlocks_RLE(const uint8 *encoded, size_t size, uint8 *blocks);
+// returns false if the encoded data ended early
+bool decodeBlocks_RLE(const uint8 *encoded, size_t size, uint8 *blocks);
 int encodeBlocks_RLE(const uint8 *blocks, uint8 *, size_t);
 void decodeBlocks_PLAIN(std::istream *is, uint8 *blocks);
 int encodeBlocks_PLAIN(const uint8 *blocks, uint8 *, size_t);
 
+// zlib works on top of one of the other encodings, these return the number
+// of bytes written or -1 if the result didn't fit or the data was corrupt
+int decodeBlocks_ZLIB(const uint8 *deflated, size_t size, uint8 *buffer, size_t capacity);
+int encodeBlocks_ZLIB(const uint8 *encoded, size_t size, uint8 *buffer, size_t capacity);
+
+// the blocks that differ from base as a count and (index, type) pairs,
+// encoding returns the number of bytes written or -1 if they didn't fit
+bool decodeBlocks_DIFF(const uint8 *encoded, size_t size, const uint8 *base, uint8 *blocks);
+int encodeBlocks_DIFF(const uint8 *blocks, const uint8 *base, uint8 *buffer, size_t size);
+
 #endif // CHUNK_COMPRESSION_HPP_
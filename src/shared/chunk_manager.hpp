@@ -1,8 +1,10 @@
 #ifndef CHUNK_MANAGER_HPP
 #define CHUNK_MANAGER_HPP
 
+#include <algorithm>
 #include <memory>
 #include <atomic>
+#include <deque>
 #include <future>
 #include <queue>
 #include <stack>
@@ -16,6 +18,34 @@
 
 class Client;
 
+/** The chunks that were edited last
+
+	An edited chunk keeps what makes its next edit cheap, which is several times the size of
+	the chunk.  Only the few chunks that were edited last should keep it, touch tells which
+	chunk fell out.
+*/
+class RecentlyEditedChunks {
+public:
+	static const size_t MAX_SIZE = 16;
+
+	// returns true if another chunk isn't among the last edited ones anymore
+	bool touch(vec3i64 chunkCoords, vec3i64 *dropped) {
+		auto it = std::find(order.begin(), order.end(), chunkCoords);
+		if (it != order.end())
+			order.erase(it);
+		order.push_front(chunkCoords);
+		if (order.size() <= MAX_SIZE)
+			return false;
+		*dropped = order.back();
+		order.pop_back();
+		return true;
+	}
+
+private:
+	// the most recently edited chunk first
+	std::deque<vec3i64> order;
+};
+
 class ChunkManager {
 public:
 	ChunkManager() = default;
@@ -0,0 +1,238 @@
+#include "io_ring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "logging.hpp"
+#include "mapped_file.hpp"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static logging::Logger logger("io");
+
+IORing::IORing(uint depth) {
+#ifdef __linux__
+	if (!setup(depth)) {
+		LOG_INFO(logger) << "io_uring is not available, archive I/O is synchronous";
+		teardown();
+	}
+#endif
+}
+
+IORing::~IORing() {
+#ifdef __linux__
+	teardown();
+#endif
+}
+
+bool IORing::runSync(std::vector<Request> &requests) {
+	bool success = true;
+	for (Request &request : requests) {
+		request.done = 0;
+		request.failed = false;
+		if (request.write) {
+			if (request.file->write(request.offset, request.buffer, request.size))
+				request.done = request.size;
+			else
+				request.failed = true;
+		} else {
+			size_t size = request.file->getSize();
+			size_t start = std::min(request.offset, size);
+			size_t end = std::min(request.offset + request.size, size);
+			memcpy(request.buffer, request.file->getData() + start, end - start);
+			request.done = end - start;
+		}
+		success = success && !request.failed;
+	}
+	return success;
+}
+
+#ifdef __linux__
+
+bool IORing::isAsync() const {
+	return _fd >= 0;
+}
+
+bool IORing::setup(uint depth) {
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	_fd = (int) syscall(__NR_io_uring_setup, depth, &params);
+	if (_fd < 0)
+		return false;
+	if (!supportsReadWrite())
+		return false;
+	_depth = params.sq_entries;
+
+	_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32);
+	_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	_sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+	if (_sq_ring == MAP_FAILED) {
+		_sq_ring = nullptr;
+		return false;
+	}
+	_cq_ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+	if (_cq_ring == MAP_FAILED) {
+		_cq_ring = nullptr;
+		return false;
+	}
+	_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	_sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+	if (_sqes == MAP_FAILED) {
+		_sqes = nullptr;
+		return false;
+	}
+
+	uint8 *sq = (uint8 *) _sq_ring;
+	_sq_tail = (uint32 *) (sq + params.sq_off.tail);
+	_sq_mask = (uint32 *) (sq + params.sq_off.ring_mask);
+	_sq_array = (uint32 *) (sq + params.sq_off.array);
+	uint8 *cq = (uint8 *) _cq_ring;
+	_cq_head = (uint32 *) (cq + params.cq_off.head);
+	_cq_tail = (uint32 *) (cq + params.cq_off.tail);
+	_cq_mask = (uint32 *) (cq + params.cq_off.ring_mask);
+	_cqes = cq + params.cq_off.cqes;
+	return true;
+}
+
+bool IORing::supportsReadWrite() const {
+	// rings came with Linux 5.1, but plain reads and writes only with 5.6,
+	// like the probe, before that every request would fail
+	const uint num_ops = 256;
+	std::vector<uint8> buffer(sizeof(io_uring_probe) + num_ops * sizeof(io_uring_probe_op));
+	io_uring_probe *probe = (io_uring_probe *) buffer.data();
+	if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, num_ops) < 0)
+		return false;
+	for (uint8 op : {(uint8) IORING_OP_READ, (uint8) IORING_OP_WRITE}) {
+		if (op >= probe->ops_len || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+			return false;
+	}
+	return true;
+}
+
+void IORing::teardown() {
+	if (_sqes)
+		munmap(_sqes, _sqes_size);
+	if (_cq_ring)
+		munmap(_cq_ring, _cq_ring_size);
+	if (_sq_ring)
+		munmap(_sq_ring, _sq_ring_size);
+	if (_fd >= 0)
+		close(_fd);
+	_sqes = _cq_ring = _sq_ring = nullptr;
+	_fd = -1;
+}
+
+bool IORing::run(std::vector<Request> &requests) {
+	if (_fd < 0)
+		return runSync(requests);
+
+	// requests that still have bytes left, short transfers are submitted
+	// again for the rest
+	std::vector<size_t> remaining;
+	for (size_t i = 0; i < requests.size(); ++i) {
+		requests[i].done = 0;
+		requests[i].failed = false;
+		if (requests[i].size > 0)
+			remaining.push_back(i);
+	}
+
+	io_uring_sqe *sqes = (io_uring_sqe *) _sqes;
+	io_uring_cqe *cqes = (io_uring_cqe *) _cqes;
+	bool unsupported = false;
+	while (!remaining.empty() && !unsupported) {
+		size_t num_submitted = std::min<size_t>(remaining.size(), _depth);
+		uint32 tail = *_sq_tail;
+		for (size_t i = 0; i < num_submitted; ++i) {
+			const Request &request = requests[remaining[i]];
+			uint32 index = tail & *_sq_mask;
+			io_uring_sqe &sqe = sqes[index];
+			memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+			sqe.fd = request.file->getDescriptor();
+			sqe.off = request.offset + request.done;
+			sqe.addr = (uint64) ((uint8 *) request.buffer + request.done);
+			sqe.len = (uint32) (request.size - request.done);
+			sqe.user_data = remaining[i];
+			_sq_array[index] = index;
+			++tail;
+		}
+		__atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+
+		size_t num_completed = 0;
+		size_t num_to_submit = num_submitted;
+		std::vector<size_t> unfinished;
+		while (num_completed < num_submitted) {
+			int result = (int) syscall(__NR_io_uring_enter, _fd, (uint) num_to_submit,
+					(uint) (num_submitted - num_completed), IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (result < 0) {
+				if (errno == EINTR)
+					continue;
+				LOG_ERROR(logger) << "io_uring_enter failed (" << errno << ")";
+				for (size_t i = 0; i < requests.size(); ++i)
+					requests[i].failed = requests[i].done < requests[i].size;
+				return false;
+			}
+			num_to_submit -= std::min<size_t>(num_to_submit, (size_t) result);
+
+			uint32 head = *_cq_head;
+			uint32 cq_tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+			for (; head != cq_tail; ++head) {
+				const io_uring_cqe &cqe = cqes[head & *_cq_mask];
+				Request &request = requests[cqe.user_data];
+				if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+					// the kernel can't do this after all
+					unsupported = true;
+				} else if (cqe.res < 0) {
+					request.failed = true;
+				} else if (cqe.res == 0) {
+					// the end of the file
+					request.failed = request.write;
+				} else {
+					request.done += (size_t) cqe.res;
+					if (request.done < request.size)
+						unfinished.push_back((size_t) cqe.user_data);
+				}
+				++num_completed;
+			}
+			__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+		}
+
+		remaining.erase(remaining.begin(), remaining.begin() + num_submitted);
+		remaining.insert(remaining.end(), unfinished.begin(), unfinished.end());
+	}
+
+	if (unsupported) {
+		// reading and writing the same bytes again does no harm, so the
+		// whole batch is simply redone
+		LOG_WARNING(logger) << "io_uring doesn't support file reads and writes, "
+				"archive I/O is synchronous";
+		teardown();
+		return runSync(requests);
+	}
+
+	bool success = true;
+	for (const Request &request : requests)
+		success = success && !request.failed;
+	return success;
+}
+
+#else
+
+bool IORing::isAsync() const {
+	return false;
+}
+
+bool IORing::run(std::vector<Request> &requests) {
+	return runSync(requests);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef IO_RING_HPP_
+#define IO_RING_HPP_
+
+#include <vector>
+
+#include "std_types.hpp"
+
+class MappedFile;
+
+/** Carries out batches of positional reads and writes on mapped files
+
+	On Linux the whole batch is handed to the kernel through an io_uring, so it only takes a
+	couple of system calls no matter how many requests it has.  Anywhere else, or if the
+	kernel doesn't let us set up a ring that can read and write files, the requests are
+	carried out one after another through the mapping.
+
+	A ring belongs to a single thread.  Writes must not reach beyond the end of their file, it
+	has to be grown beforehand.
+*/
+class IORing {
+public:
+	struct Request {
+		MappedFile *file;
+		size_t offset;
+		void *buffer;
+		size_t size;
+		bool write;
+		// bytes read or written, reads stop early at the end of the file
+		size_t done;
+		bool failed;
+	};
+
+	IORing(uint depth = 256);
+	~IORing();
+
+	IORing(const IORing &) = delete;
+	IORing &operator = (const IORing &) = delete;
+
+	// whether requests really go to the kernel in batches
+	bool isAsync() const;
+
+	// returns true iff none of the requests failed
+	bool run(std::vector<Request> &requests);
+
+private:
+	bool runSync(std::vector<Request> &requests);
+
+#ifdef __linux__
+	bool setup(uint depth);
+	bool supportsReadWrite() const;
+	void teardown();
+
+	int _fd = -1;
+	uint _depth = 0;
+
+	void *_sq_ring = nullptr;
+	size_t _sq_ring_size = 0;
+	void *_cq_ring = nullptr;
+	size_t _cq_ring_size = 0;
+	void *_sqes = nullptr;
+	size_t _sqes_size = 0;
+
+	uint32 *_sq_tail = nullptr;
+	uint32 *_sq_mask = nullptr;
+	uint32 *_sq_array = nullptr;
+	uint32 *_cq_head = nullptr;
+	uint32 *_cq_tail = nullptr;
+	uint32 *_cq_mask = nullptr;
+	void *_cqes = nullptr;
+#endif
+};
+
+#endif // IO_RING_HPP_
@@ -0,0 +1,229 @@
+#include "mapped_file.hpp"
+
+#include "logging.hpp"
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static logging::Logger logger("io");
+
+MappedFile::MappedFile() {
+	// nothing
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _MSC_VER
+
+bool MappedFile::open(const char *filename) {
+	close();
+	_file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		LOG_ERROR(logger) << "Could not open '" << filename << "' (" << GetLastError() << ")";
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size)) {
+		close();
+		return false;
+	}
+	_size = (size_t) size.QuadPart;
+	return map();
+}
+
+void MappedFile::close() {
+	unmap();
+	if (_file != INVALID_HANDLE_VALUE)
+		CloseHandle(_file);
+	_file = INVALID_HANDLE_VALUE;
+	_size = 0;
+}
+
+bool MappedFile::isOpen() const {
+	return _file != INVALID_HANDLE_VALUE;
+}
+
+bool MappedFile::write(size_t offset, const void *data, size_t size) {
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD) offset;
+	overlapped.OffsetHigh = (DWORD) ((uint64) offset >> 32);
+	DWORD written = 0;
+	if (!WriteFile(_file, data, (DWORD) size, &written, &overlapped) || written != size) {
+		LOG_ERROR(logger) << "Write to mapped file failed (" << GetLastError() << ")";
+		return false;
+	}
+	if (offset + size > _size) {
+		// a view can't be larger than its mapping, which can't be
+		// larger than the file
+		_size = offset + size;
+		unmap();
+		return map();
+	}
+	return true;
+}
+
+bool MappedFile::truncate(size_t size) {
+	// the mapping keeps the file from shrinking
+	unmap();
+	LARGE_INTEGER end;
+	end.QuadPart = (LONGLONG) size;
+	if (!SetFilePointerEx(_file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(_file)) {
+		LOG_ERROR(logger) << "Could not truncate mapped file (" << GetLastError() << ")";
+		map();
+		return false;
+	}
+	_size = size;
+	return map();
+}
+
+bool MappedFile::sync() {
+	if (_data && !FlushViewOfFile(_data, 0)) {
+		LOG_ERROR(logger) << "Could not flush mapped file (" << GetLastError() << ")";
+		return false;
+	}
+	if (!FlushFileBuffers(_file)) {
+		LOG_ERROR(logger) << "Could not flush mapped file (" << GetLastError() << ")";
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::map() {
+	if (_size == 0)
+		return true;
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+	if (_mapping == nullptr) {
+		LOG_ERROR(logger) << "Could not map file (" << GetLastError() << ")";
+		return false;
+	}
+	_data = (uint8 *) MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (_data == nullptr) {
+		LOG_ERROR(logger) << "Could not map file (" << GetLastError() << ")";
+		CloseHandle(_mapping);
+		_mapping = nullptr;
+		return false;
+	}
+	_mapped_size = _size;
+	return true;
+}
+
+void MappedFile::unmap() {
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle(_mapping);
+	_data = nullptr;
+	_mapping = nullptr;
+	_mapped_size = 0;
+}
+
+#else
+
+// the mapping is reserved beyond the end of the file, so it rarely has to
+// be moved while the file grows
+static const size_t MIN_MAPPING_SIZE = 1024 * 1024;
+
+bool MappedFile::open(const char *filename) {
+	close();
+	_fd = ::open(filename, O_RDWR | O_CREAT, 0644);
+	if (_fd < 0) {
+		LOG_ERROR(logger) << "Could not open '" << filename << "'";
+		return false;
+	}
+	struct stat st;
+	if (fstat(_fd, &st) != 0) {
+		close();
+		return false;
+	}
+	_size = (size_t) st.st_size;
+	return map();
+}
+
+void MappedFile::close() {
+	unmap();
+	if (_fd >= 0)
+		::close(_fd);
+	_fd = -1;
+	_size = 0;
+}
+
+bool MappedFile::isOpen() const {
+	return _fd >= 0;
+}
+
+bool MappedFile::write(size_t offset, const void *data, size_t size) {
+	const char *bytes = (const char *) data;
+	size_t written = 0;
+	while (written < size) {
+		ssize_t result = pwrite(_fd, bytes + written, size - written, offset + written);
+		if (result < 0) {
+			LOG_ERROR(logger) << "Write to mapped file failed";
+			return false;
+		}
+		written += (size_t) result;
+	}
+	if (offset + size > _size) {
+		_size = offset + size;
+		if (_size > _mapped_size) {
+			unmap();
+			return map();
+		}
+	}
+	return true;
+}
+
+bool MappedFile::truncate(size_t size) {
+	if (ftruncate(_fd, (off_t) size) != 0) {
+		LOG_ERROR(logger) << "Could not truncate mapped file";
+		return false;
+	}
+	_size = size;
+	if (_size > _mapped_size) {
+		unmap();
+		return map();
+	}
+	// the mapping can stay, it only reaches further beyond the end now
+	return true;
+}
+
+bool MappedFile::sync() {
+	if (_data && _size > 0 && msync(_data, _size, MS_SYNC) != 0) {
+		LOG_ERROR(logger) << "Could not flush mapped file";
+		return false;
+	}
+	if (fsync(_fd) != 0) {
+		LOG_ERROR(logger) << "Could not flush mapped file";
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::map() {
+	size_t mapped_size = MIN_MAPPING_SIZE;
+	while (mapped_size < _size)
+		mapped_size *= 2;
+	void *data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (data == MAP_FAILED) {
+		LOG_ERROR(logger) << "Could not map file";
+		return false;
+	}
+	_data = (uint8 *) data;
+	_mapped_size = mapped_size;
+	return true;
+}
+
+void MappedFile::unmap() {
+	if (_data)
+		munmap(_data, _mapped_size);
+	_data = nullptr;
+	_mapped_size = 0;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef MAPPED_FILE_HPP_
+#define MAPPED_FILE_HPP_
+
+#ifdef _MSC_VER
+#define NOMINMAX
+#include <WinSock2.h>
+#include <Windows.h>
+#endif
+
+#include "std_types.hpp"
+
+/** A file that is read through a shared memory mapping
+
+	Writes go through the file itself and grow it as needed.  Writing to the mapping directly
+	is fine as well, as long as it stays within the file.  Pointers into the mapping are only
+	valid until the next write that grows the file.
+*/
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator = (const MappedFile &) = delete;
+
+	// opens the file for reading and writing, it is created if it doesn't exist
+	bool open(const char *filename);
+	void close();
+	bool isOpen() const;
+
+	size_t getSize() const { return _size; }
+	const uint8 *getData() const { return _data; }
+	uint8 *getData() { return _data; }
+
+	bool write(size_t offset, const void *data, size_t size);
+	// cuts the file off after size bytes, or grows it with zeros
+	bool truncate(size_t size);
+	// waits until everything written so far, also through the mapping, is on the disk
+	bool sync();
+
+#ifndef _MSC_VER
+	// for reads and writes that don't go through this class
+	int getDescriptor() const { return _fd; }
+#endif
+
+private:
+	bool map();
+	void unmap();
+
+#ifdef _MSC_VER
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = nullptr;
+#else
+	int _fd = -1;
+#endif
+	uint8 *_data = nullptr;
+	size_t _size = 0;
+	size_t _mapped_size = 0;
+};
+
+#endif // MAPPED_FILE_HPP_
@@ -102,11 +102,10 @@ void setName(const char *name) {
 #else
 
 void setName(const char *) {
-	static bool b = false;
-	if (!b) {
+	// threads may start at the same time
+	static std::atomic<bool> b(false);
+	if (!b.exchange(true))
 		LOG_DEBUG(logger) << "Naming threads not implemented";
-		b = true;
-	}
 }
 
 #endif
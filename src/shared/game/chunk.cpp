@@ -1,14 +1,84 @@
 #include "chunk.hpp"
 
+#include <cstring>
+
 #include "shared/engine/logging.hpp"
 #include "shared/block_utils.hpp"
+#include "chunk_connectivity.hpp"
 
 static logging::Logger logger("chunk");
 
-Chunk::Chunk(int flags) {
+static uint getBitsForPaletteSize(size_t paletteSize) {
+	if (paletteSize <= 2)
+		return 1;
+	else if (paletteSize <= 4)
+		return 2;
+	else if (paletteSize <= 16)
+		return 4;
+	else
+		return 8;
+}
+
+template <uint BITS>
+static void unpackBlocks(const uint32 *indices, const uint8 *palette, uint8 *blocks) {
+	const uint32 mask = (1u << BITS) - 1;
+	for (size_t word = 0; word < Chunk::SIZE * BITS / 32; word++) {
+		uint32 w = indices[word];
+		for (uint shift = 0; shift < 32; shift += BITS) {
+			*blocks++ = palette[(w >> shift) & mask];
+		}
+	}
+}
+
+template <uint BITS>
+static void countIndices(const uint32 *indices, uint *counts) {
+	const uint32 mask = (1u << BITS) - 1;
+	for (size_t word = 0; word < Chunk::SIZE * BITS / 32; word++) {
+		uint32 w = indices[word];
+		for (uint shift = 0; shift < 32; shift += BITS) {
+			counts[(w >> shift) & mask]++;
+		}
+	}
+}
+
+static uint popCount(uint32 w) {
+	w = w - ((w >> 1) & 0x55555555);
+	w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+	w = (w + (w >> 4)) & 0x0F0F0F0F;
+	return (w * 0x01010101) >> 24;
+}
+
+// all air blocks in the row that are connected to one of the seeds
+static uint32 fillRow(uint32 seeds, uint32 air) {
+	uint32 up = seeds & air, upPro = air;
+	uint32 down = up, downPro = air;
+	for (uint shift = 1; shift < 32; shift <<= 1) {
+		up |= upPro & (up << shift);
+		upPro &= upPro << shift;
+		down |= downPro & (down >> shift);
+		downPro &= downPro >> shift;
+	}
+	return up | down;
+}
+
+static void countIndices(uint bits, const uint32 *indices, uint *counts) {
+	switch (bits) {
+	case 1: countIndices<1>(indices, counts); break;
+	case 2: countIndices<2>(indices, counts); break;
+	case 4: countIndices<4>(indices, counts); break;
+	case 8: countIndices<8>(indices, counts); break;
+	default: counts[0] += Chunk::SIZE; break;
+	}
+}
+
+Chunk::Chunk(int flags) :
+	palette(1, 0), indices(1, 0)
+{
 	this->flags = flags & VISUAL;
 }
 
+Chunk::~Chunk() = default;
+
 void Chunk::initCC(vec3i64 chunkCoords) {
 	this->cc = chunkCoords;
 	flags |= COORDS_INITIALIZED;
@@ -25,23 +95,79 @@ void Chunk::initPassThroughs(uint16 passThroughs) {
 }
 
 void Chunk::initBlock(vec3ui8 intraChunkCoords, uint8 type) {
-	blocks[getBlockIndex(intraChunkCoords)] = type;
+	storeBlock(getBlockIndex(intraChunkCoords), type);
 }
 
 void Chunk::initBlock(size_t index, uint8 type) {
-	blocks[index] = type;
+	storeBlock(index, type);
+}
+
+void Chunk::initBlocks(const uint8 *blocks) {
+	// palette entries are assigned in order of first occurrence
+	int lookup[256];
+	for (int i = 0; i < 256; i++)
+		lookup[i] = -1;
+	palette.clear();
+	for (size_t i = 0; i < SIZE; i++) {
+		if (lookup[blocks[i]] == -1) {
+			lookup[blocks[i]] = (int) palette.size();
+			palette.push_back(blocks[i]);
+		}
+	}
+
+	if (palette.size() == 1) {
+		initUniform(palette[0]);
+		return;
+	}
+
+	bitsPerBlock = getBitsForPaletteSize(palette.size());
+	std::vector<uint32> newIndices(SIZE * bitsPerBlock / 32);
+	size_t i = 0;
+	for (size_t word = 0; word < newIndices.size(); word++) {
+		uint32 w = 0;
+		for (uint shift = 0; shift < 32; shift += bitsPerBlock) {
+			w |= (uint32) lookup[blocks[i++]] << shift;
+		}
+		newIndices[word] = w;
+	}
+	indices.swap(newIndices);
+
+	solidRows.resize(WIDTH * WIDTH);
+	for (size_t row = 0; row < WIDTH * WIDTH; row++) {
+		uint32 solidRow = 0;
+		for (uint x = 0; x < WIDTH; x++) {
+			if (blocks[row * WIDTH + x] != 0)
+				solidRow |= 1u << x;
+		}
+		solidRows[row] = solidRow;
+	}
+}
+
+void Chunk::initUniform(uint8 type) {
+	bitsPerBlock = 0;
+	std::vector<uint8>(1, type).swap(palette);
+	std::vector<uint32>(1, 0).swap(indices);
+	std::vector<uint32>().swap(solidRows);
 }
 
 void Chunk::finishInitialization() {
 	if (!(flags & COORDS_INITIALIZED))
 		LOG_ERROR(logger) << "Chunk coordinates not initialized";
+	uint counts[256] = {0};
+	countIndices(bitsPerBlock, indices.data(), counts);
 	if (!(flags & NUM_AIR_BLOCKS_INITIALIZED)) {
-		for (size_t i = 0; i < SIZE; i++) {
-			if (blocks[i] == 0)
-				numAirBlocks++;
+		numAirBlocks = 0;
+		for (size_t i = 0; i < palette.size(); i++) {
+			if (palette[i] == 0)
+				numAirBlocks += counts[i];
 		}
 		flags |= NUM_AIR_BLOCKS_INITIALIZED;
 	}
+	// blocks written one by one might have left the chunk simpler than its
+	// storage, e.g. a generated chunk that turned out to be all stone
+	if (!isUniform())
+		compactPalette(counts, true);
+	connectivity.reset();
 
 	if ((flags & VISUAL) && !(flags & PASSTHROUGHS_INITIALIZED)) {
 		makePassThroughs();
@@ -55,94 +181,284 @@ void Chunk::reset() {
 	numAirBlocks = 0;
 	passThroughs = 0;
 	revision = 0;
+	connectivity.reset();
+
+	// give the memory back, a recycled chunk might end up much simpler
+	initUniform(0);
 }
 
 void Chunk::setBlock(size_t index, uint8 type) {
-	if (blocks[index] == type)
+	uint8 oldType = getBlock(index);
+	if (oldType == type)
 		return;
 
-	blocks[index] = type;
+	storeBlock(index, type);
 	if (type == 0)
 		numAirBlocks++;
-	else
+	else if (oldType == 0)
 		numAirBlocks--;
 	revision++;
-	if (flags & VISUAL)
-		makePassThroughs();
+	if (!(flags & VISUAL))
+		return;
+
+	if (!connectivity) {
+		uint32 airRows[WIDTH * WIDTH];
+		getAirRows(airRows);
+		connectivity.reset(new ChunkConnectivity(airRows));
+	} else if (type == 0) {
+		connectivity->setAir(index);
+	} else if (oldType == 0) {
+		connectivity->setSolid(index);
+	}
+	if (numAirBlocks > SIZE - WIDTH * WIDTH)
+		passThroughs = 0x7FFF;
+	else
+		passThroughs = connectivity->getPassThroughs();
+}
+
+void Chunk::releaseConnectivity() {
+	connectivity.reset();
 }
 
 uint8 Chunk::getBlock(vec3ui8 icc) const {
-	return blocks[getBlockIndex(icc)];
+	return getBlock(getBlockIndex(icc));
+}
+
+uint8 Chunk::getBlock(size_t index) const {
+	const size_t bitIndex = index * bitsPerBlock;
+	const uint32 mask = (1u << bitsPerBlock) - 1;
+	return palette[(indices[bitIndex >> 5] >> (bitIndex & 31)) & mask];
+}
+
+void Chunk::getBlocks(uint8 *blocks) const {
+	switch (bitsPerBlock) {
+	case 1: unpackBlocks<1>(indices.data(), palette.data(), blocks); break;
+	case 2: unpackBlocks<2>(indices.data(), palette.data(), blocks); break;
+	case 4: unpackBlocks<4>(indices.data(), palette.data(), blocks); break;
+	case 8: unpackBlocks<8>(indices.data(), palette.data(), blocks); break;
+	default: memset(blocks, palette[0], SIZE); break;
+	}
+}
+
+void Chunk::getAirRows(uint32 *rows) const {
+	if (solidRows.empty()) {
+		for (size_t row = 0; row < WIDTH * WIDTH; row++)
+			rows[row] = palette[0] == 0 ? 0xFFFFFFFF : 0;
+	} else {
+		for (size_t row = 0; row < WIDTH * WIDTH; row++)
+			rows[row] = ~solidRows[row];
+	}
+}
+
+size_t Chunk::getStorageBytes() const {
+	return sizeof(Chunk) + palette.capacity() * sizeof(uint8)
+			+ indices.capacity() * sizeof(uint32)
+			+ solidRows.capacity() * sizeof(uint32);
 }
 
 size_t Chunk::getBlockIndex(vec3ui8 icc) {
 	return (icc[2] * WIDTH + icc[1]) * WIDTH + icc[0];
 }
 
-void Chunk::makePassThroughs() {
-	if (numAirBlocks > SIZE - WIDTH * WIDTH) {
-		passThroughs = 0x7FFF;
-		return;
-	} else if (numAirBlocks == 0) {
-		passThroughs = 0x0000;
-		return;
+void Chunk::storeBlock(size_t index, uint8 type) {
+	if (bitsPerBlock == 0) {
+		// copy on write, the index buffer is only allocated once the chunk
+		// stops being uniform
+		if (palette[0] == type)
+			return;
+		solidRows.assign(WIDTH * WIDTH, palette[0] != 0 ? 0xFFFFFFFF : 0);
+		repack(1);
+	}
+	const uint32 paletteIndex = getPaletteIndex(type);
+	const size_t bitIndex = index * bitsPerBlock;
+	const uint shift = bitIndex & 31;
+	const uint32 mask = ((1u << bitsPerBlock) - 1) << shift;
+	uint32 &word = indices[bitIndex >> 5];
+	word = (word & ~mask) | (paletteIndex << shift);
+
+	const uint32 solidBit = 1u << (index & (WIDTH - 1));
+	if (type != 0)
+		solidRows[index >> WIDTH_EXPONENT] |= solidBit;
+	else
+		solidRows[index >> WIDTH_EXPONENT] &= ~solidBit;
+}
+
+uint Chunk::getPaletteIndex(uint8 type) {
+	for (size_t i = 0; i < palette.size(); i++) {
+		if (palette[i] == type)
+			return (uint) i;
+	}
+
+	if (palette.size() >= (1u << bitsPerBlock)) {
+		// while initializing, every palette entry was just written to
+		uint counts[256] = {0};
+		if (flags & INITIALIZED)
+			countIndices(bitsPerBlock, indices.data(), counts);
+		if (!(flags & INITIALIZED) || !compactPalette(counts, false))
+			repack(bitsPerBlock * 2);
 	}
-	passThroughs = 0;
-	bool visited[SIZE];
 
-	for (uint i = 0; i < SIZE; i++) {
-		visited[i] = false;
+	palette.push_back(type);
+	return (uint) palette.size() - 1;
+}
+
+bool Chunk::compactPalette(const uint *counts, bool shrink) {
+	uint32 remap[256];
+	std::vector<uint8> newPalette;
+	for (size_t i = 0; i < palette.size(); i++) {
+		if (counts[i] > 0) {
+			remap[i] = (uint32) newPalette.size();
+			newPalette.push_back(palette[i]);
+		}
 	}
 
-	size_t index = 0;
+	if (shrink && newPalette.size() == 1) {
+		initUniform(newPalette[0]);
+		return true;
+	}
+
+	uint newBitsPerBlock = shrink ? getBitsForPaletteSize(newPalette.size()) : bitsPerBlock;
+	if (newPalette.size() == palette.size() && newBitsPerBlock == bitsPerBlock)
+		return false;
+
+	std::vector<uint32> newIndices(SIZE * newBitsPerBlock / 32, 0);
+	const uint32 mask = (1u << bitsPerBlock) - 1;
+	for (size_t index = 0; index < SIZE; index++) {
+		const size_t bitIndex = index * bitsPerBlock;
+		const uint32 paletteIndex = (indices[bitIndex >> 5] >> (bitIndex & 31)) & mask;
+		const size_t newBitIndex = index * newBitsPerBlock;
+		newIndices[newBitIndex >> 5] |= remap[paletteIndex] << (newBitIndex & 31);
+	}
+	indices.swap(newIndices);
+	palette.swap(newPalette);
+	bitsPerBlock = newBitsPerBlock;
+	return true;
+}
+
+void Chunk::repack(uint newBitsPerBlock) {
+	std::vector<uint32> newIndices(SIZE * newBitsPerBlock / 32, 0);
+	const uint32 mask = (1u << bitsPerBlock) - 1;
+	for (size_t index = 0; index < SIZE; index++) {
+		const size_t bitIndex = index * bitsPerBlock;
+		const uint32 paletteIndex = (indices[bitIndex >> 5] >> (bitIndex & 31)) & mask;
+		const size_t newBitIndex = index * newBitsPerBlock;
+		newIndices[newBitIndex >> 5] |= paletteIndex << (newBitIndex & 31);
+	}
+	indices.swap(newIndices);
+	bitsPerBlock = newBitsPerBlock;
+}
+
+uint16 Chunk::computePassThroughs(const uint32 *airRows, uint numAirBlocks) {
+	if (numAirBlocks > SIZE - WIDTH * WIDTH)
+		return 0x7FFF;
+	else if (numAirBlocks == 0)
+		return 0x0000;
+
+	const size_t NUM_ROWS = WIDTH * WIDTH;
+	uint32 remaining[NUM_ROWS];
+	uint32 component[NUM_ROWS];
+	memcpy(remaining, airRows, sizeof(remaining));
+
+	uint16 passThroughs = 0;
 	uint foundAirBlocks = 0;
-	for (uint8 z = 0; z < WIDTH; z++) {
-		for (uint8 y = 0; y < WIDTH; y++) {
-			for (uint8 x = 0; x < WIDTH; x++) {
-				visited[index] = true;
-				if (blocks[index] != 0) {
-					index++;
-					continue;
-				}
+	size_t seedRow = 0;
+	while (foundAirBlocks < numAirBlocks) {
+		while (seedRow < NUM_ROWS && remaining[seedRow] == 0)
+			seedRow++;
+		if (seedRow == NUM_ROWS)
+			break;
 
-				vec3ui8 fringe[SIZE];
-				fringe[0] = vec3ui8(x, y, z);
-				int fringeSize = 1;
-				int borderSet = 0;
-				while (fringeSize > 0) {
-					foundAirBlocks++;
-					vec3ui8 icc = fringe[--fringeSize];
-					for (int d = 0; d < 6; d++) {
-						if (icc[DIR_DIMS[d]] == (1 - d / 3) * (WIDTH - 1))
-							borderSet |= (1 << d);
-						else {
-							vec3ui8 nIcc = icc + DIRS[d].cast<uint8>();
-							size_t nIndex = getBlockIndex(nIcc);
-							if (blocks[nIndex] == 0 && !visited[nIndex]) {
-								visited[nIndex] = true;
-								fringe[fringeSize++] = nIcc;
-							}
-						}
-					}
+		// flood the component of the lowest remaining air block, rows
+		// are swept back and forth until the component stops growing
+		memset(component, 0, sizeof(component));
+		const uint32 seedWord = remaining[seedRow];
+		component[seedRow] = fillRow(seedWord & (~seedWord + 1), seedWord);
+		size_t lo = seedRow;
+		size_t hi = seedRow;
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int pass = 0; pass < 2; pass++) {
+				const size_t first = lo >= WIDTH ? lo - WIDTH : 0;
+				const size_t last = hi + WIDTH < NUM_ROWS ? hi + WIDTH : NUM_ROWS - 1;
+				for (size_t k = first; k <= last; k++) {
+					const size_t row = pass == 0 ? k : first + last - k;
+					const uint32 air = remaining[row];
+					if (air == 0)
+						continue;
+					uint32 seeds = 0;
+					if (row % WIDTH > 0)
+						seeds |= component[row - 1];
+					if (row % WIDTH < WIDTH - 1)
+						seeds |= component[row + 1];
+					if (row >= WIDTH)
+						seeds |= component[row - WIDTH];
+					if (row + WIDTH < NUM_ROWS)
+						seeds |= component[row + WIDTH];
+					seeds &= air & ~component[row];
+					if (seeds == 0)
+						continue;
+					component[row] |= fillRow(seeds, air);
+					if (row < lo)
+						lo = row;
+					if (row > hi)
+						hi = row;
+					changed = true;
 				}
+			}
+		}
 
-				int shift = 0;
-				for (int d1 = 0; d1 < 5; d1++) {
-					if (borderSet & (1 << d1)) {
-						for (int d2 = d1 + 1; d2 < 6; d2++) {
-							if (borderSet & (1 << d2))
-								passThroughs |= (1 << shift);
-							shift++;
-						}
-					} else
-						shift += 5 - d1;
-				}
+		int borderSet = 0;
+		uint32 allRows = 0;
+		for (size_t row = lo; row <= hi; row++) {
+			const uint32 rowMask = component[row];
+			if (rowMask == 0)
+				continue;
+			allRows |= rowMask;
+			const size_t y = row % WIDTH;
+			const size_t z = row / WIDTH;
+			if (y == WIDTH - 1)
+				borderSet |= 1 << 1;
+			else if (y == 0)
+				borderSet |= 1 << 4;
+			if (z == WIDTH - 1)
+				borderSet |= 1 << 2;
+			else if (z == 0)
+				borderSet |= 1 << 5;
+			foundAirBlocks += popCount(rowMask);
+			remaining[row] &= ~rowMask;
+		}
+		if (allRows & (1u << (WIDTH - 1)))
+			borderSet |= 1 << 0;
+		if (allRows & 1u)
+			borderSet |= 1 << 3;
 
-				if (foundAirBlocks >= numAirBlocks)
-					return;
+		passThroughs |= getPassThroughsForBorderSet(borderSet);
+		if (passThroughs == 0x7FFF)
+			break;
+	}
 
-				index++;
+	return passThroughs;
+}
+
+uint16 Chunk::getPassThroughsForBorderSet(int borderSet) {
+	uint16 passThroughs = 0;
+	int shift = 0;
+	for (int d1 = 0; d1 < 5; d1++) {
+		if (borderSet & (1 << d1)) {
+			for (int d2 = d1 + 1; d2 < 6; d2++) {
+				if (borderSet & (1 << d2))
+					passThroughs |= (1 << shift);
+				shift++;
 			}
-		}
+		} else
+			shift += 5 - d1;
 	}
+	return passThroughs;
+}
+
+void Chunk::makePassThroughs() {
+	uint32 airRows[WIDTH * WIDTH];
+	getAirRows(airRows);
+	passThroughs = computePassThroughs(airRows, numAirBlocks);
 }
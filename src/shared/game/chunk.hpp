@@ -1,8 +1,13 @@
 #ifndef CHUNK_HPP
 #define CHUNK_HPP
 
+#include <memory>
+#include <vector>
+
 #include "shared/engine/vmath.hpp"
 
+class ChunkConnectivity;
+
 class Chunk {
 public:
 	static const uint WIDTH_EXPONENT = 5;
@@ -24,10 +29,25 @@ private:
 	uint16 passThroughs = 0;
 	uint8 flags = 0;
 
-	uint8 blocks[WIDTH * WIDTH * WIDTH];
+	// blocks are stored as bit packed indices into a palette of block
+	// types, with 1, 2, 4 or 8 bits per block depending on how many
+	// different types the chunk contains
+	// uniform chunks use 0 bits per block, their only type is palette[0]
+	// and indices is a single dummy word until a different block is set
+	uint8 bitsPerBlock = 0;
+	std::vector<uint8> palette;
+	std::vector<uint32> indices;
+	// one word per (y, z) row with bit x set if the block is not air,
+	// empty while the chunk is uniform
+	std::vector<uint32> solidRows;
+
+	// only allocated once a visual chunk is edited, about three times
+	// the size of the chunk itself
+	std::unique_ptr<ChunkConnectivity> connectivity;
 
 public:
 	Chunk(int flags = 0);
+	~Chunk();
 
 	void initCC(vec3i64 chunkCoords);
 	void initRevision(uint32 revision) { this->revision = revision; }
@@ -35,19 +55,31 @@ public:
 	void initPassThroughs(uint16 passThroughs);
 	void initBlock(vec3ui8 intraChunkCoords, uint8 type);
 	void initBlock(size_t index, uint8 type);
-	uint8 *getBlocksForInit() { return blocks; }
+	void initBlocks(const uint8 *blocks);
+	void initUniform(uint8 type);
 	void finishInitialization();
 	void reset();
 
 	void setBlock(size_t index, uint8 type);
+	// frees what keeps the pass throughs up to date while the chunk is
+	// edited, the next edit builds it again
+	void releaseConnectivity();
 	uint8 getBlock(vec3ui8 intraChunkCoords) const;
+	uint8 getBlock(size_t index) const;
+	void getBlocks(uint8 *blocks) const;
+	void getAirRows(uint32 *rows) const;
+	uint32 getSolidRow(uint y, uint z) const;
+	bool isSolid(vec3ui8 intraChunkCoords) const;
 
 	vec3i64 getCC() const { return cc; }
 	uint32 getRevision() const {return revision; }
 	uint16 getPassThroughs() const { return passThroughs; }
 	uint getNumAirBlocks() const { return numAirBlocks; }
-	const uint8 *getBlocks() const { return blocks; }
+	uint getBitsPerBlock() const { return bitsPerBlock; }
+	uint getPaletteSize() const { return (uint) palette.size(); }
+	size_t getStorageBytes() const;
 	bool isEmpty() const { return numAirBlocks == SIZE; }
+	bool isUniform() const { return bitsPerBlock == 0; }
 	bool isVisual() const { return (flags & VISUAL) != 0; }
 	bool isInitialized() const { return (flags & INITIALIZED) != 0; }
 
@@ -56,9 +88,27 @@ public:
 	static Chunk readChunk(ByteBuffer buffer);
 */
 	static size_t getBlockIndex(vec3ui8 icc);
+	// airRows holds one word per (y, z) row, bit x is set if the block
+	// at (x, y, z) is air
+	static uint16 computePassThroughs(const uint32 *airRows, uint numAirBlocks);
+	static uint16 getPassThroughsForBorderSet(int borderSet);
 
 private:
+	void storeBlock(size_t index, uint8 type);
+	uint getPaletteIndex(uint8 type);
+	bool compactPalette(const uint *counts, bool shrink);
+	void repack(uint newBitsPerBlock);
 	void makePassThroughs();
 };
 
+inline uint32 Chunk::getSolidRow(uint y, uint z) const {
+	if (solidRows.empty())
+		return palette[0] != 0 ? 0xFFFFFFFF : 0;
+	return solidRows[z * WIDTH + y];
+}
+
+inline bool Chunk::isSolid(vec3ui8 icc) const {
+	return ((getSolidRow(icc[1], icc[2]) >> icc[0]) & 1) != 0;
+}
+
 #endif // CHUNK_HPP
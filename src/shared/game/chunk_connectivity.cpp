@@ -0,0 +1,365 @@
+#include "chunk_connectivity.hpp"
+
+#include <cstring>
+
+#include "chunk.hpp"
+
+const uint16 ChunkConnectivity::NO_LABEL;
+
+static const uint WIDTH = Chunk::WIDTH;
+static const int NEIGHBOR_OFFSETS[6] = {
+	1, (int) WIDTH, (int) (WIDTH * WIDTH), -1, -(int) WIDTH, -(int) (WIDTH * WIDTH)
+};
+
+static uint getCoord(size_t index, int dim) {
+	return (index >> (Chunk::WIDTH_EXPONENT * dim)) & (WIDTH - 1);
+}
+
+static bool hasNeighbor(size_t index, int d) {
+	uint coord = getCoord(index, d % 3);
+	return d < 3 ? coord < WIDTH - 1 : coord > 0;
+}
+
+static void addFaces(uint16 *faceCounts, size_t index) {
+	for (int d = 0; d < 6; d++) {
+		if (!hasNeighbor(index, d))
+			faceCounts[d]++;
+	}
+}
+
+static void removeFaces(uint16 *faceCounts, size_t index) {
+	for (int d = 0; d < 6; d++) {
+		if (!hasNeighbor(index, d))
+			faceCounts[d]--;
+	}
+}
+
+ChunkConnectivity::ChunkConnectivity(const uint32 *airRows) :
+	labels(Chunk::SIZE, NO_LABEL)
+{
+	for (size_t row = 0; row < WIDTH * WIDTH; row++) {
+		for (uint x = 0; x < WIDTH; x++) {
+			if (airRows[row] & (1u << x))
+				labels[row * WIDTH + x] = 0;
+		}
+	}
+	build();
+}
+
+void ChunkConnectivity::setAir(size_t index) {
+	if (labels[index] != NO_LABEL)
+		return;
+	if (regions.size() > NO_LABEL - 8)
+		build();
+
+	uint16 root = newRegion(index);
+	for (int d = 0; d < 6; d++) {
+		if (!hasNeighbor(index, d))
+			continue;
+		size_t n = index + NEIGHBOR_OFFSETS[d];
+		if (labels[n] != NO_LABEL)
+			unite(root, findBlock(n));
+	}
+}
+
+void ChunkConnectivity::setSolid(size_t index) {
+	if (labels[index] == NO_LABEL)
+		return;
+	if (regions.size() > NO_LABEL - 8)
+		build();
+
+	uint16 root = findBlock(index);
+	labels[index] = NO_LABEL;
+	removeRoot(root);
+	removeFaces(regions[root].faceCounts, index);
+
+	size_t neighbors[6];
+	int numNeighbors = 0;
+	for (int d = 0; d < 6; d++) {
+		if (!hasNeighbor(index, d))
+			continue;
+		size_t n = index + NEIGHBOR_OFFSETS[d];
+		if (labels[n] != NO_LABEL)
+			neighbors[numNeighbors++] = n;
+	}
+	if (numNeighbors == 0)
+		return; // the region was this single block
+
+	addRoot(root);
+	if (numNeighbors == 1 || isLocallyConnected(index, neighbors, numNeighbors))
+		return;
+	splitRegion(root, neighbors, numNeighbors);
+}
+
+uint16 ChunkConnectivity::getPassThroughs() const {
+	uint16 passThroughs = 0;
+	for (int borderSet = 0; borderSet < 64; borderSet++) {
+		if (numRootsPerBorderSet[borderSet] > 0)
+			passThroughs |= Chunk::getPassThroughsForBorderSet(borderSet);
+	}
+	return passThroughs;
+}
+
+void ChunkConnectivity::build() {
+	// labels only tell air from solid blocks here, lower neighbors are
+	// relabeled before they are looked at
+	regions.clear();
+	for (size_t index = 0; index < Chunk::SIZE; index++) {
+		if (labels[index] == NO_LABEL)
+			continue;
+		uint16 root = NO_LABEL;
+		for (int d = 3; d < 6; d++) {
+			if (!hasNeighbor(index, d))
+				continue;
+			size_t n = index + NEIGHBOR_OFFSETS[d];
+			if (labels[n] == NO_LABEL)
+				continue;
+			uint16 other = find(labels[n]);
+			if (root == NO_LABEL) {
+				root = other;
+			} else if (other != root) {
+				regions[other].parent = root;
+				for (int f = 0; f < 6; f++)
+					regions[root].faceCounts[f] += regions[other].faceCounts[f];
+			}
+		}
+		if (root == NO_LABEL) {
+			root = (uint16) regions.size();
+			Region region;
+			region.parent = root;
+			memset(region.faceCounts, 0, sizeof(region.faceCounts));
+			regions.push_back(region);
+		}
+		labels[index] = root;
+		addFaces(regions[root].faceCounts, index);
+	}
+
+	memset(numRootsPerBorderSet, 0, sizeof(numRootsPerBorderSet));
+	for (size_t label = 0; label < regions.size(); label++) {
+		if (regions[label].parent == label)
+			addRoot((uint16) label);
+	}
+}
+
+uint16 ChunkConnectivity::newRegion(size_t index) {
+	uint16 label = (uint16) regions.size();
+	Region region;
+	region.parent = label;
+	memset(region.faceCounts, 0, sizeof(region.faceCounts));
+	addFaces(region.faceCounts, index);
+	regions.push_back(region);
+	labels[index] = label;
+	addRoot(label);
+	return label;
+}
+
+uint16 ChunkConnectivity::find(uint16 label) {
+	while (regions[label].parent != label) {
+		regions[label].parent = regions[regions[label].parent].parent;
+		label = regions[label].parent;
+	}
+	return label;
+}
+
+uint16 ChunkConnectivity::findBlock(size_t index) {
+	uint16 root = find(labels[index]);
+	labels[index] = root;
+	return root;
+}
+
+void ChunkConnectivity::unite(uint16 a, uint16 b) {
+	if (a == b)
+		return;
+	removeRoot(a);
+	removeRoot(b);
+	regions[b].parent = a;
+	for (int d = 0; d < 6; d++)
+		regions[a].faceCounts[d] += regions[b].faceCounts[d];
+	addRoot(a);
+}
+
+bool ChunkConnectivity::isLocallyConnected(size_t index,
+		const size_t *neighbors, int numNeighbors) const {
+	// search the 3x3x3 cube around the closed block, if the neighbors
+	// still meet in there the region can't have fallen apart
+	int cube[3][2];
+	for (int dim = 0; dim < 3; dim++) {
+		uint coord = getCoord(index, dim);
+		cube[dim][0] = coord > 0 ? -1 : 0;
+		cube[dim][1] = coord < WIDTH - 1 ? 1 : 0;
+	}
+	auto toLocal = [index](size_t i) {
+		int local = 0;
+		for (int dim = 2; dim >= 0; dim--)
+			local = local * 3 + (int) getCoord(i, dim) - (int) getCoord(index, dim) + 1;
+		return local;
+	};
+	const int LOCAL_OFFSETS[3] = { 1, 3, 9 };
+
+	uint32 visited = 1u << toLocal(neighbors[0]);
+	int fringe[27];
+	fringe[0] = toLocal(neighbors[0]);
+	int fringeSize = 1;
+	while (fringeSize > 0) {
+		int local = fringe[--fringeSize];
+		int offset[3] = { local % 3 - 1, local / 3 % 3 - 1, local / 9 - 1 };
+		for (int d = 0; d < 6; d++) {
+			int dim = d % 3;
+			int step = d < 3 ? 1 : -1;
+			int coord = offset[dim] + step;
+			if (coord < cube[dim][0] || coord > cube[dim][1])
+				continue;
+			int nLocal = local + step * LOCAL_OFFSETS[dim];
+			if (visited & (1u << nLocal))
+				continue;
+			int nIndex = (int) index;
+			for (int dim2 = 0; dim2 < 3; dim2++) {
+				int o = dim2 == dim ? coord : offset[dim2];
+				nIndex += o * NEIGHBOR_OFFSETS[dim2];
+			}
+			if (labels[nIndex] == NO_LABEL)
+				continue;
+			visited |= 1u << nLocal;
+			fringe[fringeSize++] = nLocal;
+		}
+	}
+
+	for (int i = 1; i < numNeighbors; i++) {
+		if (!(visited & (1u << toLocal(neighbors[i]))))
+			return false;
+	}
+	return true;
+}
+
+void ChunkConnectivity::splitRegion(uint16 root, const size_t *neighbors, int numNeighbors) {
+	// grow one search per neighbor in lockstep, searches that meet are
+	// merged; once at most one of them is still growing, every finished
+	// one has found a complete piece of the region
+	if (marks.empty())
+		marks.resize(Chunk::SIZE, 0);
+	std::vector<size_t> queues[6];
+	size_t heads[6] = {0};
+	int groupParents[6];
+	uint16 faceCounts[6][6];
+	memset(faceCounts, 0, sizeof(faceCounts));
+	for (int g = 0; g < numNeighbors; g++) {
+		groupParents[g] = g;
+		marks[neighbors[g]] = (uint8) (g + 1);
+		touched.push_back(neighbors[g]);
+		queues[g].push_back(neighbors[g]);
+		addFaces(faceCounts[g], neighbors[g]);
+	}
+	auto findGroup = [&groupParents](int g) {
+		while (groupParents[g] != g)
+			g = groupParents[g];
+		return g;
+	};
+
+	int numGroups = numNeighbors;
+	int numGrowing = numNeighbors;
+	while (numGroups > 1 && numGrowing > 1) {
+		for (int g = 0; g < numNeighbors; g++) {
+			if (heads[g] == queues[g].size())
+				continue;
+			size_t index = queues[g][heads[g]++];
+			for (int d = 0; d < 6; d++) {
+				if (!hasNeighbor(index, d))
+					continue;
+				size_t n = index + NEIGHBOR_OFFSETS[d];
+				if (labels[n] == NO_LABEL)
+					continue;
+				if (marks[n] == 0) {
+					marks[n] = (uint8) (g + 1);
+					touched.push_back(n);
+					queues[g].push_back(n);
+					addFaces(faceCounts[g], n);
+				} else {
+					int a = findGroup(g);
+					int b = findGroup(marks[n] - 1);
+					if (a != b) {
+						groupParents[b] = a;
+						numGroups--;
+					}
+				}
+			}
+		}
+
+		bool growing[6] = {false};
+		for (int g = 0; g < numNeighbors; g++) {
+			if (heads[g] < queues[g].size())
+				growing[findGroup(g)] = true;
+		}
+		numGrowing = 0;
+		for (int g = 0; g < numNeighbors; g++) {
+			if (growing[g])
+				numGrowing++;
+		}
+	}
+
+	if (numGroups > 1) {
+		// the group that is still growing keeps the old label, if all
+		// of them are finished the first one does
+		int keep = -1;
+		for (int g = 0; g < numNeighbors && keep == -1; g++) {
+			if (heads[g] < queues[g].size())
+				keep = findGroup(g);
+		}
+		if (keep == -1)
+			keep = findGroup(0);
+
+		uint16 newLabels[6];
+		removeRoot(root);
+		for (int g = 0; g < numNeighbors; g++) {
+			int group = findGroup(g);
+			if (group == keep)
+				continue;
+			if (group == g) {
+				newLabels[g] = (uint16) regions.size();
+				Region region;
+				region.parent = newLabels[g];
+				memset(region.faceCounts, 0, sizeof(region.faceCounts));
+				regions.push_back(region);
+			}
+		}
+		for (int g = 0; g < numNeighbors; g++) {
+			int group = findGroup(g);
+			if (group == keep)
+				continue;
+			for (int d = 0; d < 6; d++) {
+				regions[newLabels[group]].faceCounts[d] += faceCounts[g][d];
+				regions[root].faceCounts[d] -= faceCounts[g][d];
+			}
+		}
+		for (size_t index : touched) {
+			int group = findGroup(marks[index] - 1);
+			if (group != keep)
+				labels[index] = newLabels[group];
+		}
+		addRoot(root);
+		for (int g = 0; g < numNeighbors; g++) {
+			if (findGroup(g) != keep && findGroup(g) == g)
+				addRoot(newLabels[g]);
+		}
+	}
+
+	for (size_t index : touched)
+		marks[index] = 0;
+	touched.clear();
+}
+
+void ChunkConnectivity::addRoot(uint16 root) {
+	numRootsPerBorderSet[getBorderSet(root)]++;
+}
+
+void ChunkConnectivity::removeRoot(uint16 root) {
+	numRootsPerBorderSet[getBorderSet(root)]--;
+}
+
+int ChunkConnectivity::getBorderSet(uint16 root) const {
+	int borderSet = 0;
+	for (int d = 0; d < 6; d++) {
+		if (regions[root].faceCounts[d] > 0)
+			borderSet |= 1 << d;
+	}
+	return borderSet;
+}
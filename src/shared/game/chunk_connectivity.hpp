@@ -0,0 +1,55 @@
+#ifndef CHUNK_CONNECTIVITY_HPP
+#define CHUNK_CONNECTIVITY_HPP
+
+#include <vector>
+
+#include "shared/engine/std_types.hpp"
+
+// Labels the connected air regions of a chunk with a union-find forest
+// and counts, per region, how many of its blocks touch each chunk face.
+// Opening a block merges regions, closing one only searches the region
+// it was part of, and only if the block might have been holding it
+// together. That way the pass throughs of an edited chunk can be kept
+// up to date without flooding the whole chunk again.
+class ChunkConnectivity {
+public:
+	// airRows as produced by Chunk::getAirRows
+	ChunkConnectivity(const uint32 *airRows);
+
+	void setAir(size_t index);
+	void setSolid(size_t index);
+
+	uint16 getPassThroughs() const;
+
+private:
+	static const uint16 NO_LABEL = 0xFFFF;
+
+	struct Region {
+		uint16 parent;
+		uint16 faceCounts[6];
+	};
+
+	// label of every block, NO_LABEL for solid blocks
+	std::vector<uint16> labels;
+	std::vector<Region> regions;
+	// number of root regions touching exactly the faces in the index
+	uint16 numRootsPerBorderSet[64];
+
+	// scratch space of the search in setSolid
+	std::vector<uint8> marks;
+	std::vector<size_t> touched;
+
+	void build();
+	uint16 newRegion(size_t index);
+	uint16 find(uint16 label);
+	uint16 findBlock(size_t index);
+	void unite(uint16 a, uint16 b);
+	bool isLocallyConnected(size_t index, const size_t *neighbors, int numNeighbors) const;
+	void splitRegion(uint16 root, const size_t *neighbors, int numNeighbors);
+
+	void addRoot(uint16 root);
+	void removeRoot(uint16 root);
+	int getBorderSet(uint16 root) const;
+};
+
+#endif // CHUNK_CONNECTIVITY_HPP
@@ -30,18 +30,31 @@ ElevationGenerator::~ElevationGenerator() {
 }
 
 const ElevationChunk ElevationGenerator::getChunk(vec2i64 chunkCoords) {
+	chunksLock.lockRead();
 	auto it = chunks.find(chunkCoords);
-	if (it == chunks.end()) {
-		ElevationChunk chunk;
-		chunk.heights = new double[Chunk::SIZE];
-		generateChunk(chunkCoords, &chunk);
-		chunks.insert({chunkCoords, chunk});
+	if (it != chunks.end()) {
+		ElevationChunk chunk = it->second;
+		chunksLock.unlockRead();
 		return chunk;
 	}
-	return it->second;
+	chunksLock.unlockRead();
+
+	// generated without the lock, if another thread was faster its
+	// chunk is kept
+	ElevationChunk chunk;
+	chunk.heights = new double[Chunk::SIZE];
+	generateChunk(chunkCoords, &chunk);
+	chunksLock.lockWrite();
+	auto result = chunks.insert({chunkCoords, chunk});
+	if (!result.second) {
+		delete[] chunk.heights;
+		chunk = result.first->second;
+	}
+	chunksLock.unlockWrite();
+	return chunk;
 }
 
-void ElevationGenerator::generateChunk(vec2i64 chunkCoords, ElevationChunk *chunk) {
+void ElevationGenerator::generateChunk(vec2i64 chunkCoords, ElevationChunk *chunk) const {
 	double base[Chunk::WIDTH * Chunk::WIDTH];
 	double mountain[Chunk::WIDTH * Chunk::WIDTH];
 	basePerlin.noise2(
@@ -3,6 +3,7 @@
 
 #include <unordered_map>
 
+#include "shared/engine/rwlock.hpp"
 #include "shared/block_utils.hpp"
 #include "perlin.hpp"
 
@@ -24,16 +25,20 @@ private:
 	Perlin flatlandPerlin;
 	Perlin oceanPerlin;
 
+	// generated chunks are kept until the generator is destroyed, so
+	// their heights stay valid
 	std::unordered_map<vec2i64, ElevationChunk, size_t(*)(vec2i64)> chunks;
+	ReadWriteLock chunksLock;
 
 public:
 	ElevationGenerator(uint64 seed, const WorldParams &params);
 	virtual ~ElevationGenerator();
 
+	// may be called by any number of threads
 	const ElevationChunk getChunk(vec2i64 segmentCoords);
 
 private:
-	void generateChunk(vec2i64 segmentCoords, ElevationChunk *chunk);
+	void generateChunk(vec2i64 segmentCoords, ElevationChunk *chunk) const;
 };
 
 #endif /* ELEVATION_GENERATOR_HPP */
@@ -8,22 +8,22 @@
 
 class NoiseBase {
 public:
-	virtual double noise3(double x, double y, double z, uint octaves, double amplGain, double freqGain) = 0;
+	virtual double noise3(double x, double y, double z, uint octaves, double amplGain, double freqGain) const = 0;
 
-	virtual double noise2(double x, double y, uint octaves, double amplGain, double freqGain);
+	virtual double noise2(double x, double y, uint octaves, double amplGain, double freqGain) const;
 
 	virtual void noise3(double sx, double sy, double sz, double dx, double dy, double dz,
-			uint nx, uint ny, uint nz, uint octaves, double amplGain, double freqGain, double *buffer);
+			uint nx, uint ny, uint nz, uint octaves, double amplGain, double freqGain, double *buffer) const;
 
 	virtual void noise2(double sx, double sy, double dx, double dy,
-			uint nx, uint ny, uint octaves, double amplGain, double freqGain, double *buffer);
+			uint nx, uint ny, uint octaves, double amplGain, double freqGain, double *buffer) const;
 
-	virtual double noise3(vec3d r, int octaves, double amplGain, double freqGain) final {
+	virtual double noise3(vec3d r, int octaves, double amplGain, double freqGain) const final {
 		return noise3(r[0], r[1], r[2], octaves, amplGain, freqGain);
 	}
 
 	virtual void noise3(vec3d pos, vec3d stepSize, vec3ui numSteps,
-			uint octaves, double amplGain, double freqGain, double *buffer) final {
+			uint octaves, double amplGain, double freqGain, double *buffer) const final {
 		noise3(
 			pos[0], pos[1], pos[2],
 			stepSize[0], stepSize[1], stepSize[2],
@@ -33,7 +33,7 @@ public:
 	}
 
 	virtual void noise2(vec2d pos, vec2d stepSize, vec2ui numSteps,
-			uint octaves, double amplGain, double freqGain, double *buffer) final {
+			uint octaves, double amplGain, double freqGain, double *buffer) const final {
 		noise2(
 			pos[0], pos[1],
 			stepSize[0], stepSize[1],
@@ -44,17 +44,24 @@ public:
 };
 
 class Perlin : public NoiseBase {
+	// the hash state lives on the caller's stack, so any number of
+	// threads can share one Perlin
 	class Hasher {
 		uint16 p[0x400];
-		uint16 state = 0;
 
 	public:
-		Hasher(uint64 seed);
-		inline Hasher &reset() { state = 0; return *this; }
-		inline void feed(int v) { state = p[(state ^ v) & 0x3FF]; }
-		inline uint16 get() const { return state; }
+		class State {
+			const uint16 *p;
+			uint16 state = 0;
+
+		public:
+			State(const uint16 *p) : p(p) {}
+			inline State &operator << (int v) { state = p[(state ^ v) & 0x3FF]; return *this; }
+			inline uint16 get() const { return state; }
+		};
 
-		inline Hasher &operator << (int i) { feed(i); return *this; }
+		Hasher(uint64 seed);
+		inline State start() const { return State(p); }
 	};
 
 	Hasher hasher;
@@ -65,23 +72,35 @@ public:
 	using NoiseBase::noise3;
 	using NoiseBase::noise2;
 	
-	double noise3(double x, double y, double z, uint octaves, double amplGain, double freqGain) override;
-	double noise2(double x, double y, uint octaves, double amplGain, double freqGain) override;
+	double noise3(double x, double y, double z, uint octaves, double amplGain, double freqGain) const override;
+	double noise2(double x, double y, uint octaves, double amplGain, double freqGain) const override;
 
 	void noise3(double sx, double sy, double sz, double dx, double dy, double dz,
-			uint nx, uint ny, uint nz, uint octaves, double amplGain, double freqGain, double *buffer) override;
+			uint nx, uint ny, uint nz, uint octaves, double amplGain, double freqGain, double *buffer) const override;
 	void noise2(double sx, double sy, double dx, double dy,
-			uint nx, uint ny, uint octaves, double amplGain, double freqGain, double *buffer) override;
+			uint nx, uint ny, uint octaves, double amplGain, double freqGain, double *buffer) const override;
 
 private:
-	double perlin3(double x, double y, double z, int which_octave);
-	double perlin2(double x, double y, int which_octave);
+	double perlin3(double x, double y, double z, int which_octave) const;
+	double perlin2(double x, double y, int which_octave) const;
 	
 	void perlin3(double sx, double sy, double sz, double dx, double dy, double dz,
-			uint nx, uint ny, uint nz, int which_octave, double amplitude, double *buffer);
+			uint nx, uint ny, uint nz, int which_octave, double amplitude, double *buffer) const;
 	void perlin2(double sx, double sy, double dx, double dy,
-			uint nx, uint ny, int which_octave, double amplitude, double *buffer);
+			uint nx, uint ny, int which_octave, double amplitude, double *buffer) const;
 	
+	// hashes of the corners of the lattice cell at x, y, z, in the order
+	// aaa, aba, aab, abb, baa, bba, bab, bbb (aa, ab, ba, bb in 2D)
+	void cornerHashes3(int which_octave, int x, int y, int z, uint8 *hashes) const;
+	void cornerHashes2(int which_octave, int x, int y, uint8 *hashes) const;
+
+	// adds n samples along x within one cell to the buffer, gx and u hold the
+	// x parts of the corners' dot products and the faded x of every sample
+	static void perlin3Row(const double *const *gx, const double *u, const double *gy,
+			const double *gz, double v, double w, int n, double amplitude, double *buffer);
+	static void perlin2Row(const double *const *gx, const double *u, const double *gy,
+			double v, int n, double amplitude, double *buffer);
+
 	static double grad3(uint8 hash, double x, double y, double z);
 	static double grad2(uint8 hash, double x, double y);
 	static double fade(double t);
@@ -102,6 +102,10 @@ int World::shootRay(vec3i64 start, vec3d ray, double maxDist,
 		}
 	}
 
+	// consecutive blocks are mostly in the same chunk
+	const Chunk *chunk = nullptr;
+	vec3i64 chunkCoords;
+
 	int blockHitCounter = 0;
 	while (blockHitCounter == 0) {
 		vec3i64 oldBlock = block;
@@ -133,7 +137,12 @@ int World::shootRay(vec3i64 start, vec3d ray, double maxDist,
 
 				vec3i8 dir = DIRS[d];
 				vec3i64 nextBlock = block + dir.cast<int64>();
-				if (getBlock(nextBlock)) {
+				vec3i64 nextCC = bc2cc(nextBlock);
+				if (!chunk || nextCC != chunkCoords) {
+					chunk = chunkManager ? chunkManager->getChunk(nextCC) : nullptr;
+					chunkCoords = nextCC;
+				}
+				if (chunk && chunk->isSolid(bc2icc(nextBlock))) {
 					if (outHit != nullptr)
 						*outHit = start + vec3i64((int64)round(hit[0]), (int64)round(hit[1]), (int64)round(hit[2]));
 					if (outFaceDir != nullptr)
@@ -161,11 +170,21 @@ bool World::hasCollision(vec3i64 wc) const {
 		if (wc[i] % RESOLUTION == 0)
 			onFace[i] = 1;
 	}
-	for (int x = 0; x <= onFace[0]; x++) {
-		for (int y = 0; y <= onFace[1]; y++) {
-			for (int z = 0; z <= onFace[2]; z++) {
-				if (!getBlock(block - vec3i64(x, y, z)))
+	for (int y = 0; y <= onFace[1]; y++) {
+		for (int z = 0; z <= onFace[2]; z++) {
+			// both blocks along x usually share a row
+			vec3i64 bc = block - vec3i64(0, y, z);
+			uint32 row = getSolidRow(bc);
+			uint x = bc2icc(bc)[0];
+			if (!(row & (1u << x)))
+				return false;
+			if (onFace[0]) {
+				if (x > 0) {
+					if (!(row & (1u << (x - 1))))
+						return false;
+				} else if (!getBlock(bc - vec3i64(1, 0, 0))) {
 					return false;
+				}
 			}
 		}
 	}
@@ -187,6 +206,16 @@ uint8 World::getBlock(vec3i64 bc) const {
 	return chunk->getBlock(bc2icc(bc));
 }
 
+uint32 World::getSolidRow(vec3i64 bc) const {
+	if (!chunkManager)
+		return 0;
+	const Chunk *chunk = chunkManager->getChunk(bc2cc(bc));
+	if (!chunk)
+		return 0;
+	vec3ui8 icc = bc2icc(bc);
+	return chunk->getSolidRow(icc[1], icc[2]);
+}
+
 size_t World::getNumNeededChunks() const {
 	return neededChunks.size();
 }
@@ -47,6 +47,9 @@ public:
 
 	bool isChunkLoaded(vec3i64 cc) const;
 	uint8 getBlock(vec3i64 bc) const;
+	// solid blocks in the chunk row that contains bc, bit x is set if
+	// the block at x within the chunk is not air
+	uint32 getSolidRow(vec3i64 bc) const;
 
 	size_t getNumNeededChunks() const;
 
@@ -1,11 +1,28 @@
 #include "world_generator.hpp"
 
+#include <algorithm>
+
 #include "shared/engine/math.hpp"
 #include "shared/engine/vmath.hpp"
 #include "shared/engine/logging.hpp"
 
 static logging::Logger logger("gen");
 
+// the cave sample stride goes into the upper bits of the version
+static_assert(WorldGenerator::VERSION < 32, "WorldGenerator::VERSION collides with the cave sample stride");
+
+// the noise buffers reach 9 blocks above the chunk
+static const size_t NOISE_BUFFER_SIZE = Chunk::SIZE + 9 * Chunk::WIDTH * Chunk::WIDTH;
+
+WorldGenerator::Context::Context() :
+	tunnelSwitchBuffer(NOISE_BUFFER_SIZE),
+	cavenessBuffer(NOISE_BUFFER_SIZE),
+	surfaceBuffer(NOISE_BUFFER_SIZE),
+	tunnelBuffer(6 * Chunk::SIZE)
+{
+	// nothing
+}
+
 WorldGenerator::WorldGenerator(uint64 seed, WorldParams params) :
 	wp(params),
 	elevationGenerator(seed ^ 0x50a9259b7451453e, wp),
@@ -21,40 +38,111 @@ WorldGenerator::WorldGenerator(uint64 seed, WorldParams params) :
 	tunnelPerlin2b(    seed ^ 0x1ddb866bf73756f9),
 	tunnelPerlin3b(    seed ^ 0x649e707a89ae7cda)
 {
-	tunnelSwitchBuffer = new double[Chunk::SIZE + 9 * Chunk::WIDTH * Chunk::WIDTH];
-	cavenessBuffer = new double[Chunk::SIZE + 9 * Chunk::WIDTH * Chunk::WIDTH];
+	// the lattice has to line up across chunks
+	if (wp.caveSampleStride < 1 || Chunk::WIDTH % wp.caveSampleStride != 0) {
+		LOG_WARNING(logger) << "Cave sample stride " << wp.caveSampleStride
+				<< " doesn't divide the chunk width, sampling every block";
+		wp.caveSampleStride = 1;
+	}
 }
 
 WorldGenerator::~WorldGenerator() {
-	delete[] tunnelSwitchBuffer;
+	// nothing
 }
 
 void WorldGenerator::generateChunk(Chunk *chunk) {
+	Context context;
+	generateChunk(chunk, &context);
+}
+
+void WorldGenerator::generateChunk(Chunk *chunk, Context *context) {
+	double *tunnelSwitchBuffer = context->tunnelSwitchBuffer.data();
+	double *cavenessBuffer = context->cavenessBuffer.data();
+	double *surfaceBuffer = context->surfaceBuffer.data();
+	double *tunnelBuffer = context->tunnelBuffer.data();
 	vec3i64 cc = chunk->getCC();
 	const ElevationChunk elevation = elevationGenerator.getChunk(vec2i64(cc[0], cc[1]));
 	bool underground = cc[2] * Chunk::WIDTH <= std::ceil(elevation.max);
+
+	// chunks entirely above the surface are all air or all water
+	if (cc[2] * (int64) Chunk::WIDTH > elevation.max) {
+		if (cc[2] > 0) {
+			chunk->initUniform(0);
+			chunk->finishInitialization();
+			return;
+		} else if ((cc[2] + 1) * (int64) Chunk::WIDTH <= 1) {
+			chunk->initUniform(62);
+			chunk->finishInitialization();
+			return;
+		}
+	}
 	if (underground) {
-		tunnelSwitchPerlin.noise3(
-			cc.cast<double>() * Chunk::WIDTH / wp.tunnelSwitchScale / wp.overall_scale,
-			vec3d(1 / wp.tunnelSwitchScale / wp.overall_scale),
+		sampleCaveField(tunnelSwitchPerlin, cc * Chunk::WIDTH,
 			vec3ui(Chunk::WIDTH, Chunk::WIDTH, Chunk::WIDTH + 9),
+			wp.tunnelSwitchScale * wp.overall_scale,
 			wp.tunnelSwitchOctaves, wp.tunnelSwitchAmplGain, wp.tunnelSwitchFreqGain,
-			tunnelSwitchBuffer
+			tunnelSwitchBuffer, context
 		);
-		cavenessPerlin.noise3(
-			cc.cast<double>() * Chunk::WIDTH / wp.cavenessScale / wp.overall_scale,
-			vec3d(1 / wp.cavenessScale / wp.overall_scale),
+		sampleCaveField(cavenessPerlin, cc * Chunk::WIDTH,
 			vec3ui(Chunk::WIDTH, Chunk::WIDTH, Chunk::WIDTH + 9),
+			wp.cavenessScale * wp.overall_scale,
 			wp.cavenessOctaves, wp.cavenessAmplGain, wp.cavenessFreqGain,
-			cavenessBuffer
+			cavenessBuffer, context
+		);
+	}
+
+	// the surface noise is only needed between the elevation and some
+	// fraction of it below, so only those layers are sampled
+	int surfaceBegin = Chunk::WIDTH + 9;
+	int surfaceEnd = 0;
+	// blocks above the elevation and the sea level are air, tunnels
+	// can only be below that
+	int tunnelEnd = 0;
+	for (uint i = 0; i < Chunk::WIDTH * Chunk::WIDTH; ++i) {
+		const double h = elevation.heights[i];
+		const int64 top = (int64) std::ceil(std::max(h, 0.0)) - cc[2] * Chunk::WIDTH + 1;
+		tunnelEnd = (int) std::max<int64>(tunnelEnd, std::min<int64>(top, Chunk::WIDTH));
+		if (h * wp.surfaceRelDepth < 0)
+			continue;
+		const int64 bottom = (int64) std::floor(h - h * wp.surfaceRelDepth) - cc[2] * Chunk::WIDTH;
+		surfaceBegin = (int) std::min<int64>(surfaceBegin, std::max<int64>(bottom, 0));
+		surfaceEnd = (int) std::max<int64>(surfaceEnd, std::min<int64>(top, Chunk::WIDTH + 9));
+	}
+	if (surfaceBegin < surfaceEnd) {
+		surfacePerlin.noise3(
+			(cc * Chunk::WIDTH + vec3i64(0, 0, surfaceBegin)).cast<double>() / wp.surfaceScale,
+			vec3d(1 / wp.surfaceScale),
+			vec3ui(Chunk::WIDTH, Chunk::WIDTH, surfaceEnd - surfaceBegin),
+			wp.surfaceOctaves, wp.surfaceAmplGain, wp.surfaceFreqGain,
+			surfaceBuffer + surfaceBegin * Chunk::WIDTH * Chunk::WIDTH
 		);
 	}
 
+	// either set of tunnels is only needed where the tunnel switch picks it
+	if (underground && tunnelEnd > 0) {
+		const uint numTunnelSamples = tunnelEnd * Chunk::WIDTH * Chunk::WIDTH;
+		bool needTunnels[2] = {false, false};
+		for (uint i = 0; i < numTunnelSamples; ++i) {
+			needTunnels[0] = needTunnels[0] || tunnelSwitchBuffer[i] > -wp.tunnelSwitchOverlap;
+			needTunnels[1] = needTunnels[1] || tunnelSwitchBuffer[i] < wp.tunnelSwitchOverlap;
+		}
+		const Perlin *tunnelPerlins[6] = {
+			&tunnelPerlin1a, &tunnelPerlin2a, &tunnelPerlin3a,
+			&tunnelPerlin1b, &tunnelPerlin2b, &tunnelPerlin3b,
+		};
+		for (int i = 0; i < 6; ++i) {
+			if (!needTunnels[i / 3])
+				continue;
+			sampleCaveField(*tunnelPerlins[i], cc * Chunk::WIDTH,
+				vec3ui(Chunk::WIDTH, Chunk::WIDTH, tunnelEnd), wp.tunnelScale,
+				wp.tunnelOctaves, wp.tunnelAmplGain, wp.tunnelFreqGain,
+				tunnelBuffer + i * Chunk::SIZE, context
+			);
+		}
+	}
+
 	for (uint iccx = 0; iccx < Chunk::WIDTH; iccx++)
 	for (uint iccy = 0; iccy < Chunk::WIDTH; iccy++) {
-		int64 bcx = cc[0] * Chunk::WIDTH + iccx;
-		int64 bcy = cc[1] * Chunk::WIDTH + iccy;
-			
 		double h = elevation.heights[iccy * Chunk::WIDTH + iccx];
 		double base_vegetation = 0;
 		double base_temperature = 0;
@@ -63,7 +151,7 @@ void WorldGenerator::generateChunk(Chunk *chunk) {
 		int realDepth = 0;
 		for (int iccz = Chunk::WIDTH + 8; iccz >= 0; iccz--) {
 			int64 bcz = iccz + cc[2] * Chunk::WIDTH;
-			vec3d dbc = vec3i64(bcx, bcy, bcz).cast<double>();
+			uint index = ((iccz * Chunk::WIDTH) + iccy) * Chunk::WIDTH + iccx;
 			
 			const double depth = h - bcz;
 
@@ -75,11 +163,7 @@ void WorldGenerator::generateChunk(Chunk *chunk) {
 				const double xScale = wp.surfaceThresholdXScale;
 				double funPos = 1.0 - depth / (h * wp.surfaceRelDepth) * 2;
 				double threshold = funPos * (xScale * xScale + funPos * funPos) / (xScale * xScale + 1) * 2.0;
-				double v = surfacePerlin.noise3(
-					dbc / wp.surfaceScale,
-					wp.surfaceOctaves, wp.surfaceAmplGain, wp.surfaceFreqGain
-				);
-				if (v > threshold)
+				if (surfaceBuffer[index] > threshold)
 					solid = true;
 				else
 					solid = false;
@@ -114,7 +198,6 @@ void WorldGenerator::generateChunk(Chunk *chunk) {
 				if (block != 0) {
 					if (!underground)
 						LOG_ERROR(logger) << "Trying to generate caves, but not underground";
-					uint index = ((iccz * Chunk::WIDTH) + iccy) * Chunk::WIDTH + iccx;
 					double depthValue1 = wp.cavenessDepthGainFac1 * (1 - 1 / (depth / wp.cavenessDepthGain1 + 1));
 					double depthValue2 = wp.cavenessDepthGainFac2 * (1 - 1 / (depth / wp.cavenessDepthGain2 + 1));
 					double caveness = (cavenessBuffer[index] + 0.5) * (depthValue1 + depthValue2);
@@ -122,14 +205,10 @@ void WorldGenerator::generateChunk(Chunk *chunk) {
 					double overLap = wp.tunnelSwitchOverlap;
 					double tunnelValue1 = 0;
 					double tunnelValue2 = 0;
-					vec3d tunnelCoords(dbc / wp.tunnelScale);
 					if (tunnelSwitch > -overLap) {
-						const double v1 = std::abs(tunnelPerlin1a.noise3(
-								tunnelCoords, wp.tunnelOctaves, wp.tunnelAmplGain, wp.tunnelFreqGain));
-						const double v2 = std::abs(tunnelPerlin2a.noise3(
-								tunnelCoords, wp.tunnelOctaves, wp.tunnelAmplGain, wp.tunnelFreqGain));
-						const double v3 = std::abs(tunnelPerlin3a.noise3(
-								tunnelCoords, wp.tunnelOctaves, wp.tunnelAmplGain, wp.tunnelFreqGain));
+						const double v1 = std::abs(tunnelBuffer[0 * Chunk::SIZE + index]);
+						const double v2 = std::abs(tunnelBuffer[1 * Chunk::SIZE + index]);
+						const double v3 = std::abs(tunnelBuffer[2 * Chunk::SIZE + index]);
 						double v12 = 1 / ((v1 * v1 + 1) * (v2 * v2 + 1) - 1);
 						double v23 = 1 / ((v2 * v2 + 1) * (v3 * v3 + 1) - 1);
 						double ramp = 1;
@@ -137,13 +216,10 @@ void WorldGenerator::generateChunk(Chunk *chunk) {
 							ramp = (overLap + tunnelSwitch) / overLap;
 						tunnelValue1 = (v12 + v23) * ramp;
 					}
-					if (block != 0 && tunnelSwitch < overLap) {
-						const double v1 = std::abs(tunnelPerlin1b.noise3(
-								tunnelCoords, wp.tunnelOctaves, wp.tunnelAmplGain, wp.tunnelFreqGain));
-						const double v2 = std::abs(tunnelPerlin2b.noise3(
-								tunnelCoords, wp.tunnelOctaves, wp.tunnelAmplGain, wp.tunnelFreqGain));
-						const double v3 = std::abs(tunnelPerlin3b.noise3(
-								tunnelCoords, wp.tunnelOctaves, wp.tunnelAmplGain, wp.tunnelFreqGain));
+					if (tunnelSwitch < overLap) {
+						const double v1 = std::abs(tunnelBuffer[3 * Chunk::SIZE + index]);
+						const double v2 = std::abs(tunnelBuffer[4 * Chunk::SIZE + index]);
+						const double v3 = std::abs(tunnelBuffer[5 * Chunk::SIZE + index]);
 						double v12 = 1 / ((v1 * v1 + 1) * (v2 * v2 + 1) - 1);
 						double v23 = 1 / ((v2 * v2 + 1) * (v3 * v3 + 1) - 1);
 						double ramp = 1;
@@ -165,6 +241,60 @@ void WorldGenerator::generateChunk(Chunk *chunk) {
 	chunk->finishInitialization();
 }
 
+uint8 WorldGenerator::getVersion() const {
+	// the stride divides the chunk width, so it is a power of two
+	uint8 strideExponent = 0;
+	while ((1 << strideExponent) < wp.caveSampleStride)
+		strideExponent++;
+	return VERSION | strideExponent << 5;
+}
+
+void WorldGenerator::sampleCaveField(const Perlin &perlin, vec3i64 start, vec3ui size, double scale,
+	int octaves, double amplGain, double freqGain, double *buffer, Context *context) const
+{
+	const uint stride = wp.caveSampleStride;
+	if (stride == 1) {
+		perlin.noise3(start.cast<double>() / scale, vec3d(1 / scale), size,
+				octaves, amplGain, freqGain, buffer);
+		return;
+	}
+
+	// the lattice starts at the first block and reaches at least up to the
+	// last one, it lines up with the lattice of the neighboring chunks
+	const vec3ui coarseSize(
+			(size[0] + stride - 2) / stride + 1,
+			(size[1] + stride - 2) / stride + 1,
+			(size[2] + stride - 2) / stride + 1);
+	std::vector<double> &coarse = context->coarseBuffer;
+	coarse.resize(coarseSize[0] * coarseSize[1] * coarseSize[2]);
+	perlin.noise3(start.cast<double>() / scale, vec3d(stride / scale), coarseSize,
+			octaves, amplGain, freqGain, coarse.data());
+
+	auto lerp = [](double a, double b, double t) { return a + t * (b - a); };
+	uint index = 0;
+	for (uint z = 0; z < size[2]; ++z)
+	for (uint y = 0; y < size[1]; ++y) {
+		const uint cz = z / stride;
+		const uint cy = y / stride;
+		const uint cz1 = std::min(cz + 1, coarseSize[2] - 1);
+		const uint cy1 = std::min(cy + 1, coarseSize[1] - 1);
+		const double fz = (double) (z % stride) / stride;
+		const double fy = (double) (y % stride) / stride;
+		const double *c00 = coarse.data() + (cz * coarseSize[1] + cy) * coarseSize[0];
+		const double *c01 = coarse.data() + (cz * coarseSize[1] + cy1) * coarseSize[0];
+		const double *c10 = coarse.data() + (cz1 * coarseSize[1] + cy) * coarseSize[0];
+		const double *c11 = coarse.data() + (cz1 * coarseSize[1] + cy1) * coarseSize[0];
+		for (uint x = 0; x < size[0]; ++x) {
+			const uint cx = x / stride;
+			const uint cx1 = std::min(cx + 1, coarseSize[0] - 1);
+			const double fx = (double) (x % stride) / stride;
+			const double v0 = lerp(lerp(c00[cx], c00[cx1], fx), lerp(c01[cx], c01[cx1], fx), fy);
+			const double v1 = lerp(lerp(c10[cx], c10[cx1], fx), lerp(c11[cx], c11[cx1], fx), fy);
+			buffer[index++] = lerp(v0, v1, fz);
+		}
+	}
+}
+
 vec3i64 WorldGenerator::getSpawnLocation() {
 	const ElevationChunk elevation = elevationGenerator.getChunk(vec2i64(0, 0));
 	const double h = elevation.heights[0];
@@ -8,6 +8,8 @@
 #ifndef WORLD_GENERATOR_HPP_
 #define WORLD_GENERATOR_HPP_
 
+#include <vector>
+
 #include "shared/engine/macros.hpp"
 
 #include "elevation_generator.hpp"
@@ -63,6 +65,12 @@ struct WorldParams {
 
 	double caveThreshold = 500;
 
+	// the cave fields (caveness, tunnels and the switch between them) are
+	// only sampled every that many blocks and trilinearly interpolated in
+	// between, has to divide the chunk width, is part of the generator's
+	// version
+	int    caveSampleStride = 1;
+
 	double vegetation_xy_scale  = 1000;
 	double temperature_xy_scale = 1500;
 	double hollowness_xy_scale  = 800;
@@ -73,13 +81,45 @@ struct WorldParams {
 
 class WorldGenerator {
 public:
+	// needs to change whenever the output of generateChunk does, archived
+	// chunks can be stored as a difference to it
+	static const uint8 VERSION = 2;
+
+	/** Scratch space for generating chunks
+
+		A generator is shared by any number of threads, each of them brings its own context.
+	*/
+	class Context {
+	public:
+		Context();
+
+	private:
+		friend class WorldGenerator;
+		std::vector<double> tunnelSwitchBuffer;
+		std::vector<double> cavenessBuffer;
+		std::vector<double> surfaceBuffer;
+		// the six tunnel fields one after another, each the size of a chunk
+		std::vector<double> tunnelBuffer;
+		// the lattice of a coarsely sampled cave field
+		std::vector<double> coarseBuffer;
+	};
+
 	WorldGenerator(uint64 seed, WorldParams params);
 	~WorldGenerator();
 
+	void generateChunk(Chunk *, Context *);
+	// with a temporary context
 	void generateChunk(Chunk *);
+	// VERSION combined with the parameters that change the output of
+	// generateChunk as well, for telling stored chunks apart
+	uint8 getVersion() const;
 	vec3i64 getSpawnLocation();
 
 private:
+	// samples a cave field for size blocks from start on, see caveSampleStride
+	void sampleCaveField(const Perlin &perlin, vec3i64 start, vec3ui size, double scale,
+			int octaves, double amplGain, double freqGain, double *buffer, Context *context) const;
+
 	WorldParams wp;
 
 	ElevationGenerator elevationGenerator;
@@ -95,9 +135,6 @@ private:
 	Perlin tunnelPerlin1b;
 	Perlin tunnelPerlin2b;
 	Perlin tunnelPerlin3b;
-
-	double *tunnelSwitchBuffer;
-	double *cavenessBuffer;
 };
 
 #endif // WORLD_GENERATOR_HPP_
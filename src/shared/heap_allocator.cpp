@@ -0,0 +1,82 @@
+#include "heap_allocator.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+void HeapAllocator::rebuild(std::vector<Extent> used, uint32 end) {
+	_by_offset.clear();
+	_by_size.clear();
+	_num_free_blocks = 0;
+	_end = end;
+
+	std::sort(used.begin(), used.end());
+	uint32 pos = 0;
+	for (const Extent &extent : used) {
+		if (extent.second == 0)
+			continue;
+		if (extent.first > pos)
+			insertFree(pos, extent.first - pos);
+		pos = std::max(pos, extent.first + extent.second);
+	}
+	_end = std::max(_end, pos);
+	if (_end > pos)
+		insertFree(pos, _end - pos);
+}
+
+uint32 HeapAllocator::allocate(uint32 size) {
+	auto fit = _by_size.lower_bound(Extent(size, 0));
+	if (fit != _by_size.end()) {
+		uint32 offset = fit->second;
+		uint32 free_size = fit->first;
+		eraseFree(_by_offset.find(offset));
+		if (free_size > size)
+			insertFree(offset + size, free_size - size);
+		return offset;
+	}
+
+	// nothing fits, a hole at the end of the heap is extended
+	uint32 offset = _end;
+	if (!_by_offset.empty()) {
+		auto last = std::prev(_by_offset.end());
+		if (last->first + last->second == _end) {
+			offset = last->first;
+			eraseFree(last);
+		}
+	}
+	_end = offset + size;
+	return offset;
+}
+
+void HeapAllocator::free(uint32 offset, uint32 size) {
+	if (size == 0)
+		return;
+
+	// merge with the neighboring holes
+	auto next = _by_offset.lower_bound(offset);
+	if (next != _by_offset.end() && offset + size == next->first) {
+		size += next->second;
+		eraseFree(next);
+	}
+	auto prev = _by_offset.lower_bound(offset);
+	if (prev != _by_offset.begin()) {
+		--prev;
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			eraseFree(prev);
+		}
+	}
+	insertFree(offset, size);
+}
+
+void HeapAllocator::insertFree(uint32 offset, uint32 size) {
+	_by_offset.insert({offset, size});
+	_by_size.insert(Extent(size, offset));
+	_num_free_blocks += size;
+}
+
+void HeapAllocator::eraseFree(std::map<uint32, uint32>::iterator iter) {
+	_by_size.erase(Extent(iter->second, iter->first));
+	_num_free_blocks -= iter->second;
+	_by_offset.erase(iter);
+}
@@ -0,0 +1,41 @@
+#ifndef HEAP_ALLOCATOR_HPP_
+#define HEAP_ALLOCATOR_HPP_
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "shared/engine/std_types.hpp"
+
+/** Keeps track of the free blocks of a chunk heap
+
+	Offsets and sizes are in heap blocks.  The allocator doesn't store anything itself, it
+	is rebuilt from the extents that are in use whenever a heap is opened.  Allocations take
+	the smallest hole they fit in and grow the heap only if there is none.
+*/
+class HeapAllocator {
+public:
+	typedef std::pair<uint32, uint32> Extent;
+
+	// everything below end that isn't in used is free
+	void rebuild(std::vector<Extent> used, uint32 end);
+
+	uint32 allocate(uint32 size);
+	void free(uint32 offset, uint32 size);
+
+	uint32 getEnd() const { return _end; }
+	uint32 getNumFreeBlocks() const { return _num_free_blocks; }
+
+private:
+	void insertFree(uint32 offset, uint32 size);
+	void eraseFree(std::map<uint32, uint32>::iterator);
+
+	// free extents by offset and by (size, offset)
+	std::map<uint32, uint32> _by_offset;
+	std::set<Extent> _by_size;
+	uint32 _end = 0;
+	uint32 _num_free_blocks = 0;
+};
+
+#endif // HEAP_ALLOCATOR_HPP_
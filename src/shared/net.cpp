@@ -3,6 +3,7 @@
 #include <cstring>
 
 #include "shared/engine/logging.hpp"
+#include "shared/game/chunk.hpp"
 
 static logging::Logger logger("net");
 
@@ -66,6 +67,49 @@ MessageError readMessageHeader(const char *data, size_t size, MessageType *type)
 	size -= sizeof(type); \
 }
 
+// revisions below 8 fit into the upper bits of the byte holding the z
+// coordinate, larger ones follow that byte in 1 to 4 bytes
+static size_t getRevisionSize(uint32 rev) {
+	size_t size = 0;
+	if (rev >> 3) {
+		for (; rev; rev >>= 8)
+			size++;
+	}
+	return size;
+}
+
+static void writeRevision(uint8 byte, uint32 rev, char *&data, size_t &size) {
+	size_t numBytes = getRevisionSize(rev);
+	if (numBytes == 0) {
+		byte |= rev << 5;
+		WRITE_TYPE(byte, uint8)
+	} else {
+		byte |= 0x10 | ((numBytes - 1) << 5);
+		WRITE_TYPE(byte, uint8)
+		for (size_t j = 0; j < numBytes; j++)
+			WRITE_TYPE((rev >> (8 * j)) & 0xFF, uint8)
+	}
+}
+
+static MessageError readRevision(uint8 revInfo, uint32 *rev, const char *&data, size_t &size) {
+	if (!(revInfo & 1)) {
+		*rev = revInfo >> 1;
+		return MESSAGE_OK;
+	}
+	size_t numBytes = (revInfo >> 1) + 1;
+	if (numBytes > 4)
+		return MALFORMED_MESSAGE;
+	if (size < numBytes)
+		return ABRUPT_MESSAGE_END;
+	*rev = 0;
+	for (size_t j = 0; j < numBytes; j++) {
+		uint8 byte;
+		READ_TYPE(byte, uint8)
+		*rev |= ((uint32) byte) << (8 * j);
+	}
+	return MESSAGE_OK;
+}
+
 // PLAYER_JOIN_EVENT
 static const size_t PLAYER_JOIN_EVENT_SIZE = sizeof(uint8);
 PLAIN_MSG_START(PlayerJoinEvent, PLAYER_JOIN_EVENT, PLAYER_JOIN_EVENT_SIZE)
@@ -200,14 +244,8 @@ size_t getMessageSize(const ChunkRequest &msg) {
 	for (uint i = 0; i < msg.numChunks; i++) {
 		size += 2;
 		const ChunkRequestData &crd = msg.chunkRequestData[i];
-		if (crd.cached && (crd.cachedRevision >> 3)) {
-			size++;
-			for (int shift = 8; shift < 32; shift += 8) {
-				if (crd.cachedRevision >> shift)
-					break;
-				size++;
-			}
-		}
+		if (crd.cached)
+			size += getRevisionSize(crd.cachedRevision);
 	}
 	return size;
 }
@@ -230,22 +268,7 @@ BufferError writeMessage(const ChunkRequest &msg, char *data, size_t size) {
 		WRITE_TYPE(byte, uint8)
 		byte = rc[2] & 0xF;
 		if (cached) {
-			if (!(rev >> 3)) {
-				byte |= rev << 5;
-				WRITE_TYPE(byte, uint8)
-			} else {
-				byte |= 0x10;
-				char *infoByte = data;
-				uint8 bytes = 0;
-				uint32 shifted = rev;
-				while(shifted) {
-					WRITE_TYPE(rev & 0xFF, uint8)
-					shifted = shifted >> 8;
-					bytes++;
-				}
-				byte |= (bytes - 1) << 5;
-				*reinterpret_cast<uint8 *>(infoByte) = byte;
-			}
+			writeRevision(byte, rev, data, size);
 		} else {
 			byte |= 0xF0;
 			WRITE_TYPE(byte, uint8)
@@ -276,23 +299,13 @@ MessageError readMessageBody(const char *data, size_t size, ChunkRequest *msg) {
 		READ_TYPE(byte, uint8)
 		rc[2] = extendFourBit(byte);
 		uint8 revInfo = byte >> 4;
-		if ((revInfo & 0xF) == 0xF)
+		if ((revInfo & 0xF) == 0xF) {
 			cached = false;
-		else if (!(revInfo & 1)) {
-			cached = true;
-			rev = revInfo >> 1;
 		} else {
 			cached = true;
-			rev = 0;
-			size_t numBytes = revInfo >> 1;
-			if (numBytes > 4) return MALFORMED_MESSAGE;
-			if (size < numBytes) return ABRUPT_MESSAGE_END;
-			int shift = 0;
-			for (int j = 0; j < numBytes; j++) {
-				READ_TYPE(byte, uint8)
-				rev |= ((uint32) byte) << shift;
-				shift += 8;
-			}
+			MessageError error = readRevision(revInfo, &rev, data, size);
+			if (error)
+				return error;
 		}
 	}
 	if (size > 0)
@@ -306,15 +319,7 @@ size_t getMessageSize(const ChunkMessage &msg) {
 	size_t size = HEADER_SIZE + 1;
 	for (uint i = 0; i < msg.numChunks; i++) {
 		const ChunkMessageData &cmd = msg.chunkMessageData[i];
-		size += 4 + cmd.encodedLength;
-		if (cmd.revision >> 3) {
-			size++;
-			for (int shift = 8; shift < 32; shift += 8) {
-				if (cmd.revision >> shift)
-					break;
-				size++;
-			}
-		}
+		size += 4 + cmd.encodedLength + getRevisionSize(cmd.revision);
 	}
 	return size;
 }
@@ -337,22 +342,7 @@ BufferError writeMessage(const ChunkMessage &msg, char *data, size_t size) {
 		byte |= (rc[1] & 0xF) << 4;
 		WRITE_TYPE(byte, uint8)
 		byte = rc[2] & 0xF;
-		if (!(rev >> 3)) {
-			byte |= rev << 5;
-			WRITE_TYPE(byte, uint8)
-		} else {
-			byte |= 0x10;
-			char *infoByte = data;
-			uint8 bytes = 0;
-			uint32 shifted = rev;
-			while(shifted) {
-				WRITE_TYPE(rev & 0xFF, uint8)
-				shifted = shifted >> 8;
-				bytes++;
-			}
-			byte |= (bytes - 1) << 5;
-			*reinterpret_cast<uint8 *>(infoByte) = byte;
-		}
+		writeRevision(byte, rev, data, size);
 		WRITE_TYPE(el, uint16)
 		memcpy(data, eb, el);
 		eb += el;
@@ -384,21 +374,9 @@ MessageError readMessageBody(const char *data, size_t size, ChunkMessage *msg) {
 		rc[1] = extendFourBit(byte >> 4);
 		READ_TYPE(byte, uint8)
 		rc[2] = extendFourBit(byte);
-		uint8 revInfo = byte >> 4;
-		if (!(revInfo & 1)) {
-			rev = revInfo >> 1;
-		} else {
-			rev = 0;
-			size_t numBytes = revInfo >> 1;
-			if (numBytes > 4) return MALFORMED_MESSAGE;
-			if (size < numBytes) return ABRUPT_MESSAGE_END;
-			int shift = 0;
-			for (uint j = 0; j < numBytes; j++) {
-				READ_TYPE(byte, uint8)
-				rev |= ((uint32) byte) << shift;
-				shift += 8;
-			}
-		}
+		MessageError error = readRevision(byte >> 4, &rev, data, size);
+		if (error)
+			return error;
 		if (size < 2)
 			return ABRUPT_MESSAGE_END;
 		READ_TYPE(el, uint16)
@@ -414,6 +392,86 @@ MessageError readMessageBody(const char *data, size_t size, ChunkMessage *msg) {
 	return MESSAGE_OK;
 }
 
+// CHUNK_DELTA_MESSAGE
+static const size_t CHUNK_EDIT_SIZE = sizeof(uint16) + sizeof(uint8);
+size_t getMessageSize(const ChunkDeltaMessage &msg) {
+	size_t size = HEADER_SIZE + 1;
+	for (uint i = 0; i < msg.numChunks; i++) {
+		const ChunkDeltaData &cdd = msg.chunkDeltaData[i];
+		size += 3 + getRevisionSize(cdd.revision) + cdd.numEdits * CHUNK_EDIT_SIZE;
+	}
+	return size;
+}
+MessageType getMessageType(const ChunkDeltaMessage &) { return CHUNK_DELTA_MESSAGE; }
+BufferError writeMessage(const ChunkDeltaMessage &msg, char *data, size_t size) {
+	if (size != getMessageSize(msg))
+		return WRONG_BUFFER_LENGTH;
+	writeHeader(CHUNK_DELTA_MESSAGE, data);
+	data += HEADER_SIZE;
+	size -= HEADER_SIZE;
+	const ChunkEdit *edit = msg.edits;
+	WRITE_TYPE(msg.numChunks - 1, uint8)
+	for (uint i = 0; i < msg.numChunks; i++) {
+		const ChunkDeltaData &cdd = msg.chunkDeltaData[i];
+		const vec3i64 &rc = cdd.relCoords;
+
+		uint8 byte = rc[0] & 0xF;
+		byte |= (rc[1] & 0xF) << 4;
+		WRITE_TYPE(byte, uint8)
+		byte = rc[2] & 0xF;
+		writeRevision(byte, cdd.revision, data, size);
+		WRITE_TYPE(cdd.numEdits, uint8)
+		for (uint j = 0; j < cdd.numEdits; j++, edit++) {
+			WRITE_TYPE(edit->index, uint16)
+			WRITE_TYPE(edit->type, uint8)
+		}
+	}
+	return BUFFER_OK;
+}
+MessageError readMessageBody(const char *data, size_t size, ChunkDeltaMessage *msg) {
+	if (size < HEADER_SIZE + 1)
+		return ABRUPT_MESSAGE_END;
+	data += HEADER_SIZE;
+	size -= HEADER_SIZE;
+	ChunkEdit *edit = msg->edits;
+	int numChunksMinusOne;
+	READ_TYPE(numChunksMinusOne, uint8)
+	msg->numChunks = numChunksMinusOne + 1;
+	for (uint i = 0; i < msg->numChunks; i++) {
+		ChunkDeltaData &cdd = msg->chunkDeltaData[i];
+		vec3i64 &rc = cdd.relCoords;
+
+		if (size < 2)
+			return ABRUPT_MESSAGE_END;
+		uint8 byte;
+		READ_TYPE(byte, uint8)
+		rc[0] = extendFourBit(byte);
+		rc[1] = extendFourBit(byte >> 4);
+		READ_TYPE(byte, uint8)
+		rc[2] = extendFourBit(byte);
+		MessageError error = readRevision(byte >> 4, &cdd.revision, data, size);
+		if (error)
+			return error;
+		if (size < 1)
+			return ABRUPT_MESSAGE_END;
+		READ_TYPE(cdd.numEdits, uint8)
+		if (cdd.numEdits > MAX_EDITS_PER_CHUNK_DELTA)
+			return MALFORMED_MESSAGE;
+		if (size < cdd.numEdits * CHUNK_EDIT_SIZE)
+			return ABRUPT_MESSAGE_END;
+		for (uint j = 0; j < cdd.numEdits; j++, edit++) {
+			READ_TYPE(edit->index, uint16)
+			READ_TYPE(edit->type, uint8)
+			edit->revision = 0;
+			if (edit->index >= Chunk::SIZE)
+				return MALFORMED_MESSAGE;
+		}
+	}
+	if (size > 0)
+		return MESSAGE_TOO_LONG;
+	return MESSAGE_OK;
+}
+
 // CHUNK_ANCHOR_SET
 static const size_t CHUNK_ANCHOR_SET_SIZE = sizeof(int64) * 3;
 PLAIN_MSG_START(ChunkAnchorSet, CHUNK_ANCHOR_SET, CHUNK_ANCHOR_SET_SIZE)
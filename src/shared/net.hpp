@@ -44,6 +44,7 @@ enum MessageType : uint8 {
 	PLAYER_LEAVE_EVENT,
 	SNAPSHOT,
 	CHUNK_MESSAGE,
+	CHUNK_DELTA_MESSAGE,
 
 	// Client messages
 	PLAYER_INFO,
@@ -92,6 +93,28 @@ struct ChunkMessage {
 	uint8 *encodedBuffer;
 };
 
+// a single block change, revision is the chunk revision it resulted in
+struct ChunkEdit {
+	uint32 revision;
+	uint16 index;
+	uint8 type;
+};
+
+// brings a cached chunk from the revision the client asked with up to
+// revision by applying numEdits edits
+struct ChunkDeltaData {
+	vec3i64 relCoords;
+	uint32 revision;
+	uint numEdits;
+};
+
+const size_t MAX_EDITS_PER_CHUNK_DELTA = 64;
+struct ChunkDeltaMessage {
+	uint numChunks;
+	ChunkDeltaData chunkDeltaData[MAX_CHUNKS_PER_MESSAGE];
+	ChunkEdit *edits;
+};
+
 struct PlayerInfo {
 	std::string name;
 };
@@ -133,6 +156,7 @@ MSG_FUNCS(PlayerInfo)
 MSG_FUNCS(PlayerInput)
 MSG_FUNCS(ChunkRequest)
 MSG_FUNCS(ChunkMessage)
+MSG_FUNCS(ChunkDeltaMessage)
 MSG_FUNCS(ChunkAnchorSet)
 
 #endif // NET_HPP
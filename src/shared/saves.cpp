@@ -1,10 +1,14 @@
 #include "saves.hpp"
 
+#include <fstream>
+
+#include <boost/interprocess/sync/file_lock.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/info_parser.hpp>
 #include <boost/filesystem.hpp>
 
 #include "shared/engine/logging.hpp"
+#include "shared/game/chunk.hpp"
 #include "shared/game/world_generator.hpp"
 #include "shared/chunk_archive.hpp"
 
@@ -42,6 +46,34 @@ Save::Save(std::string id) :
 		_good = false;
 	}
 
+	_compression = pt.get<string>("world.compression", "zlib");
+	if (_compression != "zlib" && _compression != "rle" && _compression != "diff") {
+		LOG_WARNING(logger) << "'" << filename << "' had unknown compression '"
+				<< _compression << "', using zlib";
+		_compression = "zlib";
+	}
+
+	_archive_workers = pt.get<int>("world.archive_workers", 4);
+	if (_archive_workers < 1 || _archive_workers > 64) {
+		LOG_WARNING(logger) << "'" << filename << "' had " << _archive_workers
+				<< " archive workers, using 4";
+		_archive_workers = 4;
+	}
+
+	_max_open_regions = pt.get<int>("world.max_open_regions", 256);
+	if (_max_open_regions < 1) {
+		LOG_WARNING(logger) << "'" << filename << "' had " << _max_open_regions
+				<< " max open regions, using 256";
+		_max_open_regions = 256;
+	}
+
+	_cave_sample_stride = pt.get<int>("world.cave_sample_stride", 1);
+	if (_cave_sample_stride < 1 || Chunk::WIDTH % _cave_sample_stride != 0) {
+		LOG_WARNING(logger) << "'" << filename << "' had cave sample stride "
+				<< _cave_sample_stride << ", using 1";
+		_cave_sample_stride = 1;
+	}
+
 	bool needs_new_spawn = false;
 	if (!pt.get_child_optional("world.spawn")) {
 		needs_new_spawn = true;
@@ -82,6 +114,10 @@ void Save::store() {
 	
 	pt.put("world.name", _name);
 	pt.put("world.seed", _seed);
+	pt.put("world.compression", _compression);
+	pt.put("world.archive_workers", _archive_workers);
+	pt.put("world.max_open_regions", _max_open_regions);
+	pt.put("world.cave_sample_stride", _cave_sample_stride);
 	pt.put("world.spawn.x", _spawn[0]);
 	pt.put("world.spawn.y", _spawn[1]);
 	pt.put("world.spawn.z", _spawn[2]);
@@ -90,13 +126,37 @@ void Save::store() {
 	write_info(filename, pt);
 }
 
+bool Save::lock() {
+	// the lock file has to exist, what is in it doesn't matter
+	string filename = string(_path) + "session.lock";
+	ofstream(filename.c_str(), ios::app);
+	try {
+		_lock.reset(new interprocess::file_lock(filename.c_str()));
+		if (_lock->try_lock())
+			return true;
+	} catch (interprocess::interprocess_exception &e) {
+		LOG_ERROR(logger) << "'" << filename << "' could not be locked: " << e.what();
+	}
+	_lock.reset();
+	return false;
+}
+
 unique_ptr<WorldGenerator> Save::getWorldGenerator() const {
-	WorldGenerator *p_world_gen = new WorldGenerator(_seed, WorldParams());
+	WorldParams params;
+	params.caveSampleStride = _cave_sample_stride;
+	WorldGenerator *p_world_gen = new WorldGenerator(_seed, params);
 	return unique_ptr<WorldGenerator>(p_world_gen);
 }
 
 unique_ptr<ChunkArchive> Save::getChunkArchive() const {
 	string filename = string(_path) + "region/";
-	ChunkArchive *p_chunk_archive = new ChunkArchive(filename.c_str());
+	ArchiveCompression compression = ArchiveCompression::ZLIB;
+	if (_compression == "rle")
+		compression = ArchiveCompression::RLE;
+	else if (_compression == "diff")
+		compression = ArchiveCompression::DIFF;
+	// chunks that were stored as differences need the generator in any case
+	ChunkArchive *p_chunk_archive = new ChunkArchive(filename.c_str(), compression,
+			getWorldGenerator(), (size_t) _max_open_regions);
 	return unique_ptr<ChunkArchive>(p_chunk_archive);
 }
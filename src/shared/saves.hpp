@@ -8,6 +8,7 @@
 
 class WorldGenerator;
 class ChunkArchive;
+namespace boost { namespace interprocess { class file_lock; } }
 
 class Save {
 public:
@@ -18,11 +19,18 @@ public:
 	std::string getPath() const { return _path; }
 	std::string getName() const { return _name; }
 	uint64 getSeed() const { return _seed; }
+	std::string getCompression() const { return _compression; }
+	int getArchiveWorkers() const { return _archive_workers; }
+	int getMaxOpenRegions() const { return _max_open_regions; }
+	int getCaveSampleStride() const { return _cave_sample_stride; }
 	vec3i64 getSpawn() const { return _spawn; }
 	bool isGood() const { return _good; }
 
 	void initialize(std::string name, uint64 seed);
 	void store();
+	// keeps other processes from using the save for as long as this object
+	// lives, false if another one already does
+	bool lock();
 
 	std::unique_ptr<WorldGenerator> getWorldGenerator() const;
 	std::unique_ptr<ChunkArchive> getChunkArchive() const;
@@ -32,8 +40,18 @@ private:
 	std::string _path;
 	std::string _name;
 	uint64 _seed = 0;
+	// how the chunk archive compresses chunks, "zlib", "rle" or "diff"
+	std::string _compression = "zlib";
+	// number of threads loading and storing chunks if there is no io_uring
+	int _archive_workers = 4;
+	// number of region files the chunk archive keeps open
+	int _max_open_regions = 256;
+	// see WorldParams::caveSampleStride, changing it changes the terrain of
+	// chunks that weren't stored yet
+	int _cave_sample_stride = 1;
 	vec3i64 _spawn;
 	bool _good = true;
+	std::unique_ptr<boost::interprocess::file_lock> _lock;
 };
 
 #endif // SAVES_HPP_
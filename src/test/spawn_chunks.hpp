@@ -0,0 +1,33 @@
+#ifndef SPAWN_CHUNKS_HPP_
+#define SPAWN_CHUNKS_HPP_
+
+#include <vector>
+
+#include "shared/engine/vmath.hpp"
+#include "shared/game/chunk.hpp"
+#include "shared/game/world_generator.hpp"
+#include "shared/block_utils.hpp"
+
+/** Chunks of generated terrain around the spawn location of a world
+
+	The chunks span from min to max, both inclusive and relative to the chunk at the spawn
+	location, with x varying fastest and z slowest.  They are generated unless generate is
+	false.  The caller deletes them.
+*/
+inline std::vector<Chunk *> makeSpawnChunks(WorldGenerator *generator, vec3i64 min,
+		vec3i64 max, bool generate = true, int flags = Chunk::VISUAL) {
+	vec3i64 spawnCC = bc2cc(generator->getSpawnLocation());
+	std::vector<Chunk *> chunks;
+	for (int64 z = min[2]; z <= max[2]; ++z)
+	for (int64 y = min[1]; y <= max[1]; ++y)
+	for (int64 x = min[0]; x <= max[0]; ++x) {
+		Chunk *chunk = new Chunk(flags);
+		chunk->initCC(spawnCC + vec3i64(x, y, z));
+		if (generate)
+			generator->generateChunk(chunk);
+		chunks.push_back(chunk);
+	}
+	return chunks;
+}
+
+#endif // SPAWN_CHUNKS_HPP_
@@ -0,0 +1,411 @@
+#include "test/gtest.hpp"
+#include "test/spawn_chunks.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "shared/engine/std_types.hpp"
+#include "shared/engine/time.hpp"
+#include "shared/game/chunk.hpp"
+#include "shared/game/world_generator.hpp"
+#include "shared/block_utils.hpp"
+
+using namespace testing;
+
+namespace {
+
+// the breadth first search the bitset flood fill replaced, kept as a
+// reference for correctness and speed
+uint16 referencePassThroughs(const uint8 *blocks, uint numAirBlocks) {
+	const uint WIDTH = Chunk::WIDTH;
+	if (numAirBlocks > Chunk::SIZE - WIDTH * WIDTH)
+		return 0x7FFF;
+	else if (numAirBlocks == 0)
+		return 0x0000;
+
+	uint16 passThroughs = 0;
+	std::vector<bool> visited(Chunk::SIZE, false);
+	std::vector<vec3ui8> fringe(Chunk::SIZE);
+
+	size_t index = 0;
+	uint foundAirBlocks = 0;
+	for (uint8 z = 0; z < WIDTH; z++) {
+		for (uint8 y = 0; y < WIDTH; y++) {
+			for (uint8 x = 0; x < WIDTH; x++) {
+				if (visited[index] || blocks[index] != 0) {
+					index++;
+					continue;
+				}
+				visited[index] = true;
+
+				fringe[0] = vec3ui8(x, y, z);
+				int fringeSize = 1;
+				int borderSet = 0;
+				while (fringeSize > 0) {
+					foundAirBlocks++;
+					vec3ui8 icc = fringe[--fringeSize];
+					for (int d = 0; d < 6; d++) {
+						if (icc[DIR_DIMS[d]] == (1 - d / 3) * (WIDTH - 1))
+							borderSet |= (1 << d);
+						else {
+							vec3ui8 nIcc = icc + DIRS[d].cast<uint8>();
+							size_t nIndex = Chunk::getBlockIndex(nIcc);
+							if (blocks[nIndex] == 0 && !visited[nIndex]) {
+								visited[nIndex] = true;
+								fringe[fringeSize++] = nIcc;
+							}
+						}
+					}
+				}
+
+				int shift = 0;
+				for (int d1 = 0; d1 < 5; d1++) {
+					if (borderSet & (1 << d1)) {
+						for (int d2 = d1 + 1; d2 < 6; d2++) {
+							if (borderSet & (1 << d2))
+								passThroughs |= (1 << shift);
+							shift++;
+						}
+					} else
+						shift += 5 - d1;
+				}
+
+				if (foundAirBlocks >= numAirBlocks)
+					return passThroughs;
+
+				index++;
+			}
+		}
+	}
+	return passThroughs;
+}
+
+uint16 referencePassThroughs(const Chunk &chunk) {
+	std::vector<uint8> blocks(Chunk::SIZE);
+	chunk.getBlocks(blocks.data());
+	return referencePassThroughs(blocks.data(), chunk.getNumAirBlocks());
+}
+
+} // namespace
+
+TEST(ChunkTest, PaletteRoundTrip) {
+	Chunk chunk;
+	chunk.initCC({ 0, 0, 0 });
+
+	std::minstd_rand rng;
+	rng.seed(1);
+	std::uniform_int_distribution<uint> distr(0, 255);
+
+	uint8 blocks[Chunk::SIZE];
+	for (size_t i = 0; i < Chunk::SIZE; ++i)
+		blocks[i] = (uint8) distr(rng);
+	chunk.initBlocks(blocks);
+	chunk.finishInitialization();
+
+	ASSERT_EQ(8u, chunk.getBitsPerBlock());
+	uint8 unpacked[Chunk::SIZE];
+	chunk.getBlocks(unpacked);
+	for (size_t i = 0; i < Chunk::SIZE; ++i) {
+		ASSERT_EQ(blocks[i], chunk.getBlock(i)) << "Block " << i << " differs";
+		ASSERT_EQ(blocks[i], unpacked[i]) << "Unpacked block " << i << " differs";
+	}
+}
+
+TEST(ChunkTest, PaletteGrowth) {
+	Chunk chunk;
+	chunk.initCC({ 0, 0, 0 });
+	for (size_t i = 0; i < Chunk::SIZE; ++i)
+		chunk.initBlock(i, (uint8) (i / 0x1000 % 2));
+	chunk.finishInitialization();
+
+	EXPECT_EQ(1u, chunk.getBitsPerBlock());
+	EXPECT_EQ(Chunk::SIZE / 2, chunk.getNumAirBlocks());
+
+	uint expectedBits[] = { 2, 2, 4, 4 };
+	for (uint8 type = 2; type < 6; ++type) {
+		chunk.setBlock(type * 100, type);
+		EXPECT_EQ(expectedBits[type - 2], chunk.getBitsPerBlock());
+	}
+
+	for (size_t i = 0; i < Chunk::SIZE; ++i) {
+		uint8 expected = (uint8) (i / 0x1000 % 2);
+		if (i % 100 == 0 && i / 100 >= 2 && i / 100 < 6)
+			expected = (uint8) (i / 100);
+		ASSERT_EQ(expected, chunk.getBlock(i)) << "Block " << i << " differs";
+	}
+}
+
+TEST(ChunkTest, PaletteCompaction) {
+	Chunk chunk;
+	chunk.initCC({ 0, 0, 0 });
+	for (size_t i = 0; i < Chunk::SIZE; ++i)
+		chunk.initBlock(i, (uint8) (i % 4));
+	chunk.finishInitialization();
+	ASSERT_EQ(2u, chunk.getBitsPerBlock());
+
+	// remove every block of type 3, then introduce a new type
+	for (size_t i = 3; i < Chunk::SIZE; i += 4)
+		chunk.setBlock(i, 1);
+	chunk.setBlock(0, 7);
+
+	EXPECT_EQ(2u, chunk.getBitsPerBlock()) << "Unused palette entry was not reused";
+	EXPECT_EQ(7, chunk.getBlock((size_t) 0));
+	EXPECT_EQ(1, chunk.getBlock((size_t) 3));
+	EXPECT_EQ(2, chunk.getBlock((size_t) 6));
+}
+
+TEST(ChunkTest, StorageScalesWithComplexity) {
+	Chunk simple;
+	simple.initCC({ 0, 0, 0 });
+	Chunk complex;
+	complex.initCC({ 0, 0, 0 });
+
+	uint8 blocks[Chunk::SIZE];
+	for (size_t i = 0; i < Chunk::SIZE; ++i)
+		blocks[i] = i < Chunk::SIZE / 2 ? 1 : 0;
+	simple.initBlocks(blocks);
+	for (size_t i = 0; i < Chunk::SIZE; ++i)
+		blocks[i] = (uint8) (i % 200);
+	complex.initBlocks(blocks);
+
+	// one bit per block plus the solid row masks
+	EXPECT_LT(simple.getStorageBytes(), Chunk::SIZE / 3);
+	EXPECT_GE(complex.getStorageBytes(), (size_t) Chunk::SIZE);
+}
+
+TEST(ChunkTest, UniformCopyOnWrite) {
+	Chunk chunk;
+	chunk.initCC({ 0, 0, 0 });
+	chunk.initUniform(1);
+	chunk.finishInitialization();
+
+	ASSERT_TRUE(chunk.isUniform());
+	EXPECT_EQ(0u, chunk.getNumAirBlocks());
+	EXPECT_LT(chunk.getStorageBytes(), (size_t) 256);
+	EXPECT_EQ(1, chunk.getBlock((size_t) 1234));
+
+	chunk.setBlock(1234, 1);
+	EXPECT_TRUE(chunk.isUniform()) << "Setting the same type materialized the chunk";
+	EXPECT_EQ(0u, chunk.getRevision());
+
+	chunk.setBlock(1234, 0);
+	EXPECT_FALSE(chunk.isUniform());
+	EXPECT_EQ(1u, chunk.getNumAirBlocks());
+	EXPECT_EQ(0, chunk.getBlock((size_t) 1234));
+	EXPECT_EQ(1, chunk.getBlock((size_t) 1235));
+}
+
+TEST(ChunkTest, UniformAfterInitialization) {
+	Chunk chunk;
+	chunk.initCC({ 0, 0, 0 });
+	for (size_t i = 0; i < Chunk::SIZE; ++i)
+		chunk.initBlock(i, 3);
+	chunk.finishInitialization();
+
+	EXPECT_TRUE(chunk.isUniform());
+	EXPECT_EQ(3, chunk.getBlock((size_t) 0));
+	EXPECT_EQ(3, chunk.getBlock((size_t) (Chunk::SIZE - 1)));
+}
+
+TEST(ChunkTest, PassThroughsMatchReference) {
+	std::minstd_rand rng;
+	rng.seed(2);
+
+	// random caves of varying density, plus a few hand made shapes
+	for (int density = 5; density < 100; density += 5) {
+		std::uniform_int_distribution<int> distr(0, 99);
+		uint8 blocks[Chunk::SIZE];
+		for (size_t i = 0; i < Chunk::SIZE; ++i)
+			blocks[i] = distr(rng) < density ? 0 : 1;
+
+		Chunk chunk(Chunk::VISUAL);
+		chunk.initCC({ 0, 0, 0 });
+		chunk.initBlocks(blocks);
+		chunk.finishInitialization();
+		EXPECT_EQ(referencePassThroughs(chunk), chunk.getPassThroughs())
+				<< "Air density " << density << "%";
+	}
+
+	// a straight tunnel along x and a u-turn through the top face
+	Chunk chunk(Chunk::VISUAL);
+	chunk.initCC({ 0, 0, 0 });
+	chunk.initUniform(1);
+	chunk.finishInitialization();
+	EXPECT_EQ(0, chunk.getPassThroughs());
+	for (uint8 x = 0; x < Chunk::WIDTH; ++x)
+		chunk.setBlock(Chunk::getBlockIndex(vec3ui8(x, 5, 7)), 0);
+	EXPECT_EQ(referencePassThroughs(chunk), chunk.getPassThroughs());
+	for (uint8 z = 7; z < Chunk::WIDTH; ++z)
+		chunk.setBlock(Chunk::getBlockIndex(vec3ui8(20, 9, z)), 0);
+	EXPECT_EQ(referencePassThroughs(chunk), chunk.getPassThroughs());
+	for (uint8 y = 5; y < 10; ++y)
+		chunk.setBlock(Chunk::getBlockIndex(vec3ui8(20, y, 7)), 0);
+	EXPECT_EQ(referencePassThroughs(chunk), chunk.getPassThroughs());
+
+	// generated caves around the surface
+	WorldGenerator generator(42, WorldParams());
+	for (Chunk *generated : makeSpawnChunks(&generator, { 0, 0, -1 }, { 1, 0, 0 })) {
+		vec3i64 cc = generated->getCC();
+		EXPECT_EQ(referencePassThroughs(*generated), generated->getPassThroughs())
+				<< "Chunk " << cc[0] << "," << cc[1] << "," << cc[2];
+		delete generated;
+	}
+}
+
+// only timing, run it with --gtest_also_run_disabled_tests
+TEST(ChunkTest, DISABLED_PassThroughsBenchmark) {
+	WorldGenerator generator(42, WorldParams());
+	std::vector<Chunk *> chunks = makeSpawnChunks(&generator, { -2, -2, -3 }, { 1, 1, 1 });
+
+	const int REPETITIONS = 10;
+	std::vector<uint32> airRows(Chunk::WIDTH * Chunk::WIDTH);
+	std::vector<uint8> blocks(Chunk::SIZE);
+	Time referenceTime = 0;
+	Time bitsetTime = 0;
+	for (Chunk *chunk : chunks) {
+		chunk->getBlocks(blocks.data());
+		uint16 expected = 0;
+		Time start = getCurrentTime();
+		for (int i = 0; i < REPETITIONS; ++i)
+			expected = referencePassThroughs(blocks.data(), chunk->getNumAirBlocks());
+		referenceTime += getCurrentTime() - start;
+
+		uint16 actual = 0;
+		start = getCurrentTime();
+		for (int i = 0; i < REPETITIONS; ++i) {
+			chunk->getAirRows(airRows.data());
+			actual = Chunk::computePassThroughs(airRows.data(), chunk->getNumAirBlocks());
+		}
+		bitsetTime += getCurrentTime() - start;
+
+		vec3i64 cc = chunk->getCC();
+		EXPECT_EQ(expected, actual)
+				<< "Chunk " << cc[0] << "," << cc[1] << "," << cc[2];
+		EXPECT_EQ(expected, chunk->getPassThroughs());
+	}
+
+	const double runs = (double) (chunks.size() * REPETITIONS);
+	std::cout << "[          ] pass throughs for " << chunks.size()
+			<< " generated chunks: breadth first search "
+			<< referenceTime / runs << "us, bitset flood fill "
+			<< bitsetTime / runs << "us per chunk" << std::endl;
+
+	for (Chunk *chunk : chunks)
+		delete chunk;
+}
+
+TEST(ChunkTest, PassThroughsFollowEdits) {
+	std::minstd_rand rng;
+	rng.seed(3);
+	std::uniform_int_distribution<int> percent(0, 99);
+	std::uniform_int_distribution<size_t> position(0, Chunk::SIZE - 1);
+
+	// thin walls that edits keep breaking and sealing
+	uint8 blocks[Chunk::SIZE];
+	for (size_t i = 0; i < Chunk::SIZE; ++i) {
+		vec3ui8 icc(i % Chunk::WIDTH, i / Chunk::WIDTH % Chunk::WIDTH, i / Chunk::WIDTH / Chunk::WIDTH);
+		bool wall = icc[0] % 8 == 3 || icc[1] % 8 == 5 || icc[2] % 16 == 9;
+		blocks[i] = wall || percent(rng) < 10 ? 1 : 0;
+	}
+	Chunk chunk(Chunk::VISUAL);
+	chunk.initCC({ 0, 0, 0 });
+	chunk.initBlocks(blocks);
+	chunk.finishInitialization();
+
+	uint32 airRows[Chunk::WIDTH * Chunk::WIDTH];
+	for (int edit = 0; edit < 3000; ++edit) {
+		size_t index = position(rng);
+		chunk.setBlock(index, chunk.getBlock(index) == 0 ? (uint8) (1 + percent(rng) % 3) : 0);
+		chunk.getAirRows(airRows);
+		ASSERT_EQ(Chunk::computePassThroughs(airRows, chunk.getNumAirBlocks()),
+				chunk.getPassThroughs()) << "Edit " << edit;
+		// chunks that weren't edited in a while are rebuilt on the next edit
+		if (edit % 500 == 499)
+			chunk.releaseConnectivity();
+	}
+
+	// punch a tunnel through everything and fill it in again
+	for (uint8 x = 0; x < Chunk::WIDTH; ++x) {
+		chunk.setBlock(Chunk::getBlockIndex(vec3ui8(x, 12, 20)), 0);
+		chunk.getAirRows(airRows);
+		ASSERT_EQ(Chunk::computePassThroughs(airRows, chunk.getNumAirBlocks()),
+				chunk.getPassThroughs()) << "Opening " << (int) x;
+	}
+	for (uint8 x = 0; x < Chunk::WIDTH; ++x) {
+		chunk.setBlock(Chunk::getBlockIndex(vec3ui8(x, 12, 20)), 1);
+		chunk.getAirRows(airRows);
+		ASSERT_EQ(Chunk::computePassThroughs(airRows, chunk.getNumAirBlocks()),
+				chunk.getPassThroughs()) << "Closing " << (int) x;
+	}
+}
+
+TEST(ChunkTest, PassThroughsSurviveManyEdits) {
+	// every opened block takes a new region label, they run out after
+	// 65535 of these and have to be compacted
+	Chunk chunk(Chunk::VISUAL);
+	chunk.initCC({ 0, 0, 0 });
+	chunk.initUniform(1);
+	chunk.finishInitialization();
+	for (uint8 x = 0; x < Chunk::WIDTH; ++x) {
+		if (x != 17)
+			chunk.setBlock(Chunk::getBlockIndex(vec3ui8(x, 0, 4)), 0);
+	}
+	const size_t gap = Chunk::getBlockIndex(vec3ui8(17, 0, 4));
+	for (int i = 0; i < 70000; ++i) {
+		chunk.setBlock(gap, 0);
+		chunk.setBlock(gap, 1);
+	}
+	uint32 airRows[Chunk::WIDTH * Chunk::WIDTH];
+	chunk.getAirRows(airRows);
+	EXPECT_EQ(Chunk::computePassThroughs(airRows, chunk.getNumAirBlocks()),
+			chunk.getPassThroughs());
+	chunk.setBlock(gap, 0);
+	chunk.getAirRows(airRows);
+	EXPECT_EQ(Chunk::computePassThroughs(airRows, chunk.getNumAirBlocks()),
+			chunk.getPassThroughs());
+	EXPECT_NE(0, chunk.getPassThroughs());
+}
+
+TEST(ChunkTest, SolidRowsFollowBlocks) {
+	std::minstd_rand rng;
+	rng.seed(4);
+	std::uniform_int_distribution<int> distr(0, 3);
+
+	Chunk chunk;
+	chunk.initCC({ 0, 0, 0 });
+	chunk.initUniform(2);
+	chunk.finishInitialization();
+	EXPECT_EQ(0xFFFFFFFFu, chunk.getSolidRow(7, 9));
+
+	std::uniform_int_distribution<size_t> position(0, Chunk::SIZE - 1);
+	for (int edit = 0; edit < 5000; ++edit)
+		chunk.setBlock(position(rng), (uint8) distr(rng));
+
+	for (uint z = 0; z < Chunk::WIDTH; ++z) {
+		for (uint y = 0; y < Chunk::WIDTH; ++y) {
+			uint32 expected = 0;
+			for (uint x = 0; x < Chunk::WIDTH; ++x) {
+				if (chunk.getBlock(vec3ui8(x, y, z)) != 0)
+					expected |= 1u << x;
+			}
+			ASSERT_EQ(expected, chunk.getSolidRow(y, z)) << "Row " << y << "," << z;
+		}
+	}
+
+	uint8 blocks[Chunk::SIZE];
+	chunk.getBlocks(blocks);
+	Chunk copy;
+	copy.initCC({ 0, 0, 0 });
+	copy.initBlocks(blocks);
+	copy.finishInitialization();
+	for (uint z = 0; z < Chunk::WIDTH; ++z) {
+		for (uint y = 0; y < Chunk::WIDTH; ++y)
+			ASSERT_EQ(chunk.getSolidRow(y, z), copy.getSolidRow(y, z));
+	}
+	EXPECT_EQ(chunk.getBlock(vec3ui8(3, 4, 5)) != 0, copy.isSolid(vec3ui8(3, 4, 5)));
+
+	copy.reset();
+	EXPECT_EQ(0u, copy.getSolidRow(0, 0));
+}
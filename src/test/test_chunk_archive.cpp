@@ -1,11 +1,19 @@
 #include "test/gtest.hpp"
+#include "test/spawn_chunks.hpp"
 
 #include <cstring>
 #include <cstdlib>
 #include <random>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
 
 #include "shared/engine/std_types.hpp"
 #include "shared/game/chunk.hpp"
+#include "shared/game/world_generator.hpp"
+#include "shared/block_utils.hpp"
+#include "shared/archive_journal.hpp"
 #include "shared/chunk_archive.hpp"
 
 using namespace testing;
@@ -14,7 +22,7 @@ float getRelativeChunkDifference(const Chunk &lhs, const Chunk &rhs) {
 	size_t failed = 0;
 
 	for (size_t i = 0; i < Chunk::SIZE; ++i) {
-		if (lhs.getBlocks()[i] != rhs.getBlocks()[i])
+		if (lhs.getBlock(i) != rhs.getBlock(i))
 			++failed;
 	}
 
@@ -27,6 +35,7 @@ float getRelativeChunkDifference(const Chunk &lhs, const Chunk &rhs) {
 void store_and_load(const Chunk &supposed, Chunk *actual) {
 	ChunkArchive archive("./test/temp/");
 	archive.storeChunk(supposed);
+	archive.checkpoint();
 	actual->initCC(supposed.getCC());
 	archive.loadChunk(actual);
 }
@@ -53,6 +62,7 @@ TEST(ChunkArchiveTest, AirChunk) {
 	});
 	store_and_load(supposed, &actual);
 	EXPECT_EQ(0, getRelativeChunkDifference(supposed, actual)) << "Air chunk did not store and load properly";
+	EXPECT_TRUE(actual.isUniform()) << "Air chunk was not loaded as uniform chunk";
 }
 
 TEST(ChunkArchiveTest, StoneChunk) {
@@ -65,6 +75,7 @@ TEST(ChunkArchiveTest, StoneChunk) {
 	});
 	store_and_load(supposed, &actual);
 	EXPECT_EQ(0, getRelativeChunkDifference(supposed, actual)) << "Stone chunk did not store and load properly";
+	EXPECT_TRUE(actual.isUniform()) << "Stone chunk was not loaded as uniform chunk";
 }
 
 TEST(ChunkArchiveTest, UncompressibleChunk) {
@@ -199,3 +210,632 @@ TEST(ChunkArchiveTest, SameRegion) {
 	archive.loadChunk(&actual);
 	ASSERT_EQ(0, getRelativeChunkDifference(c3, actual)) << "Chunks from same region collide";
 }
+
+static uint8 terrainBlock(size_t x, size_t y, size_t z, size_t index) {
+	if (z > 8 + (x * y) % 7)
+		return 0;
+	return index % 97 == 0 ? 3 : 1;
+}
+
+TEST(ChunkArchiveTest, ReadsAllCompressions) {
+	Chunk supposed;
+	supposed.initCC({ 0, 0, 0 });
+	initChunk(supposed, terrainBlock);
+	Chunk other;
+	other.initCC({ 1, 0, 0 });
+	initChunk(other, [](size_t x, size_t y, size_t z, size_t index) {
+		return terrainBlock(y, x, z, index);
+	});
+
+	{
+		ChunkArchive archive("./test/temp/mixed/", ArchiveCompression::RLE);
+		archive.storeChunk(supposed);
+	}
+	{
+		ChunkArchive archive("./test/temp/mixed/", ArchiveCompression::ZLIB);
+		archive.storeChunk(other);
+	}
+
+	for (ArchiveCompression compression : { ArchiveCompression::RLE, ArchiveCompression::ZLIB }) {
+		ChunkArchive archive("./test/temp/mixed/", compression);
+		Chunk actual;
+		actual.initCC(supposed.getCC());
+		ASSERT_TRUE(archive.loadChunk(&actual));
+		EXPECT_EQ(0, getRelativeChunkDifference(supposed, actual)) << "RLE chunk did not load properly";
+
+		Chunk otherActual;
+		otherActual.initCC(other.getCC());
+		ASSERT_TRUE(archive.loadChunk(&otherActual));
+		EXPECT_EQ(0, getRelativeChunkDifference(other, otherActual)) << "ZLIB chunk did not load properly";
+	}
+}
+
+TEST(ChunkArchiveTest, ZlibShrinksChunks) {
+	std::vector<Chunk *> chunks;
+	for (int64 i = 0; i < 8; ++i) {
+		Chunk *chunk = new Chunk();
+		chunk->initCC({ i, 0, 0 });
+		initChunk(*chunk, [i](size_t x, size_t y, size_t z, size_t index) {
+			return terrainBlock(x + i, y, z, index);
+		});
+		chunks.push_back(chunk);
+	}
+
+	{
+		ChunkArchive rle("./test/temp/rle/", ArchiveCompression::RLE);
+		ChunkArchive zlib("./test/temp/zlib/", ArchiveCompression::ZLIB);
+		for (Chunk *chunk : chunks) {
+			rle.storeChunk(*chunk);
+			zlib.storeChunk(*chunk);
+		}
+	}
+
+	using namespace boost::filesystem;
+	uintmax_t rleBytes = file_size(path("./test/temp/rle/0_0_0.region"));
+	uintmax_t zlibBytes = file_size(path("./test/temp/zlib/0_0_0.region"));
+	EXPECT_LT(zlibBytes, rleBytes);
+
+	ChunkArchive zlib("./test/temp/zlib/");
+	for (Chunk *chunk : chunks) {
+		Chunk actual;
+		actual.initCC(chunk->getCC());
+		ASSERT_TRUE(zlib.loadChunk(&actual));
+		EXPECT_EQ(0, getRelativeChunkDifference(*chunk, actual)) << "ZLIB chunk did not load properly";
+		delete chunk;
+	}
+}
+
+static uintmax_t getDirectorySize(const char *dir) {
+	using namespace boost::filesystem;
+	uintmax_t bytes = 0;
+	for (directory_iterator iter(dir), end; iter != end; ++iter)
+		bytes += file_size(iter->path());
+	return bytes;
+}
+
+TEST(ChunkArchiveTest, DiffAgainstGenerator) {
+	const uint64 SEED = 42;
+	std::unique_ptr<WorldGenerator> generator(new WorldGenerator(SEED, WorldParams()));
+
+	// a few edited chunks around the surface at spawn
+	std::vector<Chunk *> chunks = makeSpawnChunks(generator.get(), { 0, 0, -1 }, { 1, 0, 0 }, true, 0);
+	for (Chunk *chunk : chunks) {
+		for (size_t i = 0; i < 6; ++i)
+			chunk->setBlock(i * 4099 % Chunk::SIZE, (uint8) (i + 1));
+	}
+
+	{
+		ChunkArchive zlib("./test/temp/zlib_terrain/", ArchiveCompression::ZLIB);
+		ChunkArchive diff("./test/temp/diff/", ArchiveCompression::DIFF,
+				std::unique_ptr<WorldGenerator>(new WorldGenerator(SEED, WorldParams())));
+		for (Chunk *chunk : chunks) {
+			zlib.storeChunk(*chunk);
+			diff.storeChunk(*chunk);
+		}
+	}
+
+	EXPECT_LT(getDirectorySize("./test/temp/diff/"), getDirectorySize("./test/temp/zlib_terrain/"));
+
+	// loading works with any compression, as long as there is a generator
+	ChunkArchive archive("./test/temp/diff/", ArchiveCompression::ZLIB,
+			std::unique_ptr<WorldGenerator>(new WorldGenerator(SEED, WorldParams())));
+	ChunkArchive noGenerator("./test/temp/diff/");
+	// a generator with other parameters would patch different terrain
+	WorldParams coarseParams;
+	coarseParams.caveSampleStride = 4;
+	ChunkArchive otherGenerator("./test/temp/diff/", ArchiveCompression::ZLIB,
+			std::unique_ptr<WorldGenerator>(new WorldGenerator(SEED, coarseParams)));
+	for (Chunk *chunk : chunks) {
+		Chunk actual;
+		actual.initCC(chunk->getCC());
+		ASSERT_TRUE(archive.loadChunk(&actual));
+		EXPECT_EQ(0, getRelativeChunkDifference(*chunk, actual)) << "Diff chunk did not load properly";
+
+		Chunk failed;
+		failed.initCC(chunk->getCC());
+		EXPECT_FALSE(noGenerator.loadChunk(&failed));
+		Chunk mismatched;
+		mismatched.initCC(chunk->getCC());
+		EXPECT_FALSE(otherGenerator.loadChunk(&mismatched));
+		delete chunk;
+	}
+}
+
+TEST(ChunkArchiveTest, ReopenAfterGrowth) {
+	std::minstd_rand rng;
+	rng.seed(2);
+	std::uniform_int_distribution<uint> distr(0, 254);
+
+	// enough random chunks to outgrow the initial mapping of the region
+	std::vector<Chunk *> chunks;
+	for (int64 i = 0; i < 48; ++i) {
+		Chunk *chunk = new Chunk();
+		chunk->initCC({ i % 4, i / 4 % 4, i / 16 });
+		initChunk(*chunk, [&rng, &distr](size_t, size_t, size_t, size_t) {return distr(rng);});
+		chunks.push_back(chunk);
+	}
+
+	{
+		ChunkArchive archive("./test/temp/growth/");
+		for (Chunk *chunk : chunks) {
+			archive.storeChunk(*chunk);
+			uint32 revision;
+			EXPECT_TRUE(archive.hasChunk(chunk->getCC(), &revision));
+		}
+		Chunk actual;
+		actual.initCC(chunks[0]->getCC());
+		ASSERT_TRUE(archive.loadChunk(&actual));
+		EXPECT_EQ(0, getRelativeChunkDifference(*chunks[0], actual)) << "Chunk did not survive growing the region";
+	}
+
+	ChunkArchive archive("./test/temp/growth/");
+	for (Chunk *chunk : chunks) {
+		Chunk actual;
+		actual.initCC(chunk->getCC());
+		ASSERT_TRUE(archive.loadChunk(&actual));
+		EXPECT_EQ(0, getRelativeChunkDifference(*chunk, actual)) << "Chunk did not survive reopening the region";
+		delete chunk;
+	}
+}
+
+TEST(ChunkArchiveTest, RelocatedChunksReuseSpace) {
+	std::minstd_rand rng;
+	rng.seed(4);
+	std::uniform_int_distribution<uint> distr(0, 254);
+
+	Chunk small[2];
+	Chunk large[2];
+	for (int64 i = 0; i < 2; ++i) {
+		small[i].initCC({ i, 0, 0 });
+		initChunk(small[i], terrainBlock);
+		large[i].initCC({ i, 0, 0 });
+		initChunk(large[i], [&rng, &distr](size_t, size_t, size_t, size_t) {return distr(rng);});
+	}
+
+	// both chunks keep growing and shrinking, which moves them around
+	for (int round = 0; round < 20; ++round) {
+		ChunkArchive archive("./test/temp/reuse/");
+		archive.storeChunk(round % 2 ? large[0] : small[0]);
+		archive.storeChunk(round % 2 ? small[1] : large[1]);
+	}
+
+	// without reusing freed blocks every round would append a new chunk
+	using namespace boost::filesystem;
+	EXPECT_LT(file_size(path("./test/temp/reuse/0_0_0.region")), 6u * Chunk::SIZE);
+
+	ChunkArchive archive("./test/temp/reuse/");
+	Chunk actual;
+	actual.initCC(large[0].getCC());
+	ASSERT_TRUE(archive.loadChunk(&actual));
+	EXPECT_EQ(0, getRelativeChunkDifference(large[0], actual)) << "Relocated chunk did not load properly";
+	actual.initCC(small[1].getCC());
+	ASSERT_TRUE(archive.loadChunk(&actual));
+	EXPECT_EQ(0, getRelativeChunkDifference(small[1], actual)) << "Relocated chunk did not load properly";
+}
+
+TEST(ChunkArchiveTest, CompactRegions) {
+	std::minstd_rand rng;
+	rng.seed(5);
+	std::uniform_int_distribution<uint> distr(0, 254);
+
+	const int NUM_CHUNKS = 8;
+	Chunk small[2 * NUM_CHUNKS];
+	Chunk large;
+	initChunk(large, [&rng, &distr](size_t, size_t, size_t, size_t) {return distr(rng);});
+	for (int i = 0; i < 2 * NUM_CHUNKS; ++i) {
+		// half of them in a region with negative coordinates
+		int64 x = i < NUM_CHUNKS ? i : -20 - (i - NUM_CHUNKS);
+		small[i].initCC({ x, 2, 0 });
+		initChunk(small[i], terrainBlock);
+	}
+
+	ChunkArchive archive("./test/temp/compact/");
+	// every chunk leaves most of the space it first needed behind
+	for (int i = 0; i < 2 * NUM_CHUNKS; ++i) {
+		large.initCC(small[i].getCC());
+		archive.storeChunk(large);
+	}
+	archive.checkpoint();
+	for (int i = 0; i < 2 * NUM_CHUNKS; ++i)
+		archive.storeChunk(small[i]);
+	archive.checkpoint();
+
+	// closed regions are compacted as well
+	archive.clean();
+	uintmax_t fragmented_size = getDirectorySize("./test/temp/compact/");
+	EXPECT_EQ(2, archive.compactRegions());
+	uintmax_t compacted_size = getDirectorySize("./test/temp/compact/");
+	EXPECT_LT(compacted_size * 4, fragmented_size);
+	EXPECT_EQ(0, archive.compactRegions()) << "Compacted regions were still fragmented";
+
+	archive.clean();
+	ChunkArchive reopened("./test/temp/compact/");
+	for (int i = 0; i < 2 * NUM_CHUNKS; ++i) {
+		Chunk actual;
+		actual.initCC(small[i].getCC());
+		ASSERT_TRUE(reopened.loadChunk(&actual));
+		EXPECT_EQ(0, getRelativeChunkDifference(small[i], actual)) << "Compacted chunk did not load properly";
+	}
+}
+
+TEST(ChunkArchiveTest, JournaledChunksLoad) {
+	Chunk supposed[2];
+	for (int64 i = 0; i < 2; ++i) {
+		supposed[i].initCC({ i, 0, 0 });
+		initChunk(supposed[i], terrainBlock);
+		supposed[i].initRevision(7);
+	}
+
+	ChunkArchive archive("./test/temp/journaled/");
+	archive.storeChunks({ &supposed[0], &supposed[1] });
+	for (int i = 0; i < 2; ++i) {
+		uint32 revision = 0;
+		EXPECT_TRUE(archive.hasChunk(supposed[i].getCC(), &revision));
+		EXPECT_EQ(7u, revision);
+
+		Chunk actual;
+		actual.initCC(supposed[i].getCC());
+		ASSERT_TRUE(archive.loadChunk(&actual)) << "Journaled chunk could not be loaded";
+		EXPECT_EQ(0, getRelativeChunkDifference(supposed[i], actual));
+		EXPECT_EQ(7u, actual.getRevision());
+	}
+
+	EXPECT_TRUE(archive.checkpoint());
+	for (int i = 0; i < 2; ++i) {
+		Chunk actual;
+		actual.initCC(supposed[i].getCC());
+		ASSERT_TRUE(archive.loadChunk(&actual)) << "Checkpointed chunk could not be loaded";
+		EXPECT_EQ(0, getRelativeChunkDifference(supposed[i], actual));
+	}
+}
+
+TEST(ChunkArchiveTest, JournalReplayedOnOpen) {
+	using namespace boost::filesystem;
+	create_directories(path("./test/temp/replay/"));
+	const char *journal_filename = "./test/temp/replay/chunks.journal";
+
+	Chunk supposed[3];
+	for (int64 i = 0; i < 3; ++i) {
+		// the last chunk is only partially written
+		supposed[i].initCC({ 0, i, -3 * i });
+		initChunk(supposed[i], [i](size_t x, size_t y, size_t z, size_t index) {
+			return (uint8) (i == 1 ? 0 : terrainBlock(x, y, z, index) + i);
+		});
+	}
+
+	uintmax_t intact_size;
+	{
+		// an archive that was killed before it could apply its journal
+		ArchiveJournal journal;
+		std::vector<ArchiveJournal::Record> records;
+		ASSERT_TRUE(journal.open(journal_filename, &records));
+		ASSERT_TRUE(records.empty());
+		records.resize(3);
+		for (int i = 0; i < 3; ++i)
+			ArchiveJournal::makeRecord(supposed[i], &records[i]);
+		ASSERT_TRUE(journal.append(std::vector<ArchiveJournal::Record>(records.begin(), records.begin() + 2)));
+		intact_size = journal.getSize();
+		ASSERT_TRUE(journal.append(std::vector<ArchiveJournal::Record>(1, records[2])));
+	}
+	resize_file(path(journal_filename), file_size(path(journal_filename)) - 5);
+	EXPECT_LT(intact_size, file_size(path(journal_filename)));
+
+	{
+		ChunkArchive archive("./test/temp/replay/");
+		EXPECT_GT(intact_size, file_size(path(journal_filename))) << "Replayed journal was not cleared";
+		EXPECT_FALSE(archive.hasChunk(supposed[2].getCC())) << "Torn journal record was replayed";
+	}
+
+	// the replayed chunks are in the region files now
+	ChunkArchive archive("./test/temp/replay/");
+	for (int i = 0; i < 2; ++i) {
+		Chunk actual;
+		actual.initCC(supposed[i].getCC());
+		ASSERT_TRUE(archive.loadChunk(&actual)) << "Replayed chunk " << i << " could not be loaded";
+		EXPECT_EQ(0, getRelativeChunkDifference(supposed[i], actual)) << "Replayed chunk did not load properly";
+	}
+}
+
+TEST(ChunkArchiveTest, JournalRewrite) {
+	using namespace boost::filesystem;
+	create_directories(path("./test/temp/rewrite/"));
+	const char *journal_filename = "./test/temp/rewrite/chunks.journal";
+
+	Chunk supposed[3];
+	std::vector<ArchiveJournal::Record> records(3);
+	for (int64 i = 0; i < 3; ++i) {
+		supposed[i].initCC({ i, 0, 0 });
+		initChunk(supposed[i], [i](size_t x, size_t y, size_t z, size_t index) {
+			return (uint8) (terrainBlock(x, y, z, index) + i);
+		});
+		ArchiveJournal::makeRecord(supposed[i], &records[i]);
+	}
+
+	{
+		// only the chunks that were stored during a checkpoint are kept
+		ArchiveJournal journal;
+		std::vector<ArchiveJournal::Record> replayed;
+		ASSERT_TRUE(journal.open(journal_filename, &replayed));
+		ASSERT_TRUE(journal.append(std::vector<ArchiveJournal::Record>(records.begin(), records.begin() + 2)));
+		ASSERT_TRUE(journal.rewrite(std::vector<ArchiveJournal::Record>(1, records[1])));
+		EXPECT_EQ(file_size(path(journal_filename)), journal.getSize());
+		ASSERT_TRUE(journal.append(std::vector<ArchiveJournal::Record>(1, records[2])));
+	}
+
+	ArchiveJournal journal;
+	std::vector<ArchiveJournal::Record> replayed;
+	ASSERT_TRUE(journal.open(journal_filename, &replayed));
+	ASSERT_EQ(2u, replayed.size()) << "Rewritten journal did not keep exactly its records";
+	for (int i = 0; i < 2; ++i) {
+		Chunk actual;
+		actual.initCC(replayed[i].cc);
+		ASSERT_TRUE(ArchiveJournal::initChunk(replayed[i], &actual));
+		EXPECT_EQ(0, getRelativeChunkDifference(supposed[i + 1], actual));
+	}
+}
+
+TEST(ChunkArchiveTest, ConcurrentLoadsAndStores) {
+	const int NUM_THREADS = 4;
+	const int64 CHUNKS_PER_THREAD = 32;
+
+	// the threads' chunks are interleaved, so they share their regions
+	std::vector<Chunk> supposed(NUM_THREADS * CHUNKS_PER_THREAD);
+	for (size_t i = 0; i < supposed.size(); ++i) {
+		supposed[i].initCC({ (int64) i % 24 - 12, (int64) i / 24, 0 });
+		initChunk(supposed[i], [i](size_t x, size_t y, size_t z, size_t index) {
+			return (uint8) ((terrainBlock(x, y, z, index) + i) % 7);
+		});
+	}
+
+	ChunkArchive archive("./test/temp/concurrent/");
+	bool loaded[NUM_THREADS] = {false};
+	float differences[NUM_THREADS] = {0};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < NUM_THREADS; ++t) {
+		threads.emplace_back([&, t]() {
+			std::vector<const Chunk *> batch;
+			for (size_t i = t; i < supposed.size(); i += NUM_THREADS) {
+				batch.push_back(&supposed[i]);
+				if (batch.size() == 4) {
+					archive.storeChunks(batch);
+					batch.clear();
+				}
+				if (t == 0 && i % 32 == 0)
+					archive.checkpoint();
+			}
+
+			loaded[t] = true;
+			for (size_t i = t; i < supposed.size(); i += NUM_THREADS) {
+				Chunk actual;
+				actual.initCC(supposed[i].getCC());
+				loaded[t] = archive.loadChunk(&actual) && loaded[t];
+				differences[t] += getRelativeChunkDifference(supposed[i], actual);
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+
+	for (int t = 0; t < NUM_THREADS; ++t) {
+		EXPECT_TRUE(loaded[t]) << "Thread " << t << " could not load its chunks";
+		EXPECT_EQ(0, differences[t]) << "Thread " << t << " loaded wrong chunks";
+	}
+
+	// the same once everything went through the region files
+	ASSERT_TRUE(archive.checkpoint());
+	for (const Chunk &chunk : supposed) {
+		Chunk actual;
+		actual.initCC(chunk.getCC());
+		ASSERT_TRUE(archive.loadChunk(&actual));
+		EXPECT_EQ(0, getRelativeChunkDifference(chunk, actual));
+	}
+}
+
+TEST(ChunkArchiveTest, BatchedLoads) {
+	std::vector<Chunk> supposed(40);
+	for (size_t i = 0; i < supposed.size(); ++i) {
+		// a few regions, with an empty chunk among them
+		supposed[i].initCC({ (int64) i % 20 - 10, 0, (int64) i / 20 });
+		initChunk(supposed[i], [i](size_t x, size_t y, size_t z, size_t index) {
+			return (uint8) (i == 7 ? 0 : (terrainBlock(x, y, z, index) * (i + 1)) % 5);
+		});
+	}
+
+	ChunkArchive archive("./test/temp/batched/");
+	std::vector<const Chunk *> stored;
+	for (const Chunk &chunk : supposed)
+		stored.push_back(&chunk);
+	archive.storeChunks(stored);
+	ASSERT_TRUE(archive.checkpoint());
+
+	IORing ring;
+	for (IORing *r : { (IORing *) nullptr, &ring }) {
+		std::vector<Chunk> actual(supposed.size() + 1);
+		std::vector<Chunk *> loaded;
+		for (size_t i = 0; i < supposed.size(); ++i) {
+			actual[i].initCC(supposed[i].getCC());
+			loaded.push_back(&actual[i]);
+		}
+		// was never stored
+		actual.back().initCC({ 3, 100, 0 });
+		loaded.push_back(&actual.back());
+
+		EXPECT_EQ((int) supposed.size(), archive.loadChunks(loaded, r));
+		for (size_t i = 0; i < supposed.size(); ++i)
+			EXPECT_EQ(0, getRelativeChunkDifference(supposed[i], actual[i])) << "Chunk " << i;
+		EXPECT_FALSE(actual.back().isInitialized());
+	}
+}
+
+TEST(ChunkArchiveTest, ManifestTracksStatistics) {
+	using namespace boost::filesystem;
+	const char *dir = "./test/temp/manifest/";
+	auto expectScanned = [dir](const ChunkArchive::Statistics &statistics) {
+		// without a manifest the archive looks at all of its regions
+		remove(path(std::string(dir) + "archive.manifest"));
+		ChunkArchive scanned(dir);
+		ChunkArchive::Statistics expected = scanned.getStatistics();
+		EXPECT_EQ(expected.file_bytes, statistics.file_bytes);
+		EXPECT_EQ(expected.used_bytes, statistics.used_bytes);
+		EXPECT_EQ(expected.total_bytes, statistics.total_bytes);
+	};
+
+	std::vector<Chunk> chunks(24);
+	ChunkArchive::Statistics statistics;
+	{
+		ChunkArchive archive(dir);
+		std::vector<const Chunk *> stored;
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			chunks[i].initCC({ (int64) i - 12, 0, 0 });
+			initChunk(chunks[i], [i](size_t, size_t, size_t, size_t index) {
+				return (uint8) ((index * (i + 3)) % 11);
+			});
+			stored.push_back(&chunks[i]);
+		}
+		archive.storeChunks(stored);
+		ASSERT_TRUE(archive.checkpoint());
+
+		// shrink some chunks, so there is something to compact
+		for (size_t i = 0; i < chunks.size(); i += 2) {
+			initChunk(chunks[i], [](size_t, size_t, size_t, size_t) { return (uint8) 1; });
+			archive.storeChunk(chunks[i]);
+		}
+		ASSERT_TRUE(archive.checkpoint());
+		statistics = archive.getStatistics();
+		EXPECT_LT(statistics.used_bytes, statistics.total_bytes);
+	}
+	{
+		// reopening reads the manifest
+		ChunkArchive archive(dir);
+		ChunkArchive::Statistics reopened = archive.getStatistics();
+		EXPECT_EQ(statistics.file_bytes, reopened.file_bytes);
+		EXPECT_EQ(statistics.used_bytes, reopened.used_bytes);
+		EXPECT_EQ(statistics.total_bytes, reopened.total_bytes);
+	}
+	expectScanned(statistics);
+
+	{
+		ChunkArchive archive(dir);
+		EXPECT_EQ(0, archive.compactRegions()) << "Regions were compacted without being scanned";
+		EXPECT_EQ(2, archive.compactRegions(0.0f, -1, 0, true));
+		statistics = archive.getStatistics();
+		EXPECT_EQ(statistics.used_bytes, statistics.total_bytes);
+	}
+	expectScanned(statistics);
+}
+
+TEST(ChunkArchiveTest, OpenRegionsAreBounded) {
+	const size_t MAX_OPEN_REGIONS = 3;
+	std::vector<Chunk> supposed(10);
+	for (size_t i = 0; i < supposed.size(); ++i) {
+		// every chunk in a region of its own
+		supposed[i].initCC({ (int64) i * 16, 0, 0 });
+		initChunk(supposed[i], [i](size_t x, size_t y, size_t z, size_t index) {
+			return (uint8) (terrainBlock(x, y, z, index) + i);
+		});
+	}
+
+	ChunkArchive archive("./test/temp/bounded/", ArchiveCompression::ZLIB, nullptr,
+			MAX_OPEN_REGIONS);
+	for (const Chunk &chunk : supposed) {
+		archive.storeChunk(chunk);
+		ASSERT_TRUE(archive.checkpoint());
+		EXPECT_GE(MAX_OPEN_REGIONS, archive.getNumOpenRegions());
+	}
+
+	// the regions are reopened in any order
+	for (int pass = 0; pass < 2; ++pass) {
+		for (size_t i = 0; i < supposed.size(); ++i) {
+			size_t j = pass == 0 ? i : supposed.size() - 1 - i;
+			Chunk actual;
+			actual.initCC(supposed[j].getCC());
+			ASSERT_TRUE(archive.loadChunk(&actual));
+			EXPECT_EQ(0, getRelativeChunkDifference(supposed[j], actual));
+			EXPECT_GE(MAX_OPEN_REGIONS, archive.getNumOpenRegions());
+		}
+	}
+
+	archive.clean();
+	EXPECT_EQ(0u, archive.getNumOpenRegions());
+}
+
+TEST(ChunkArchiveTest, LookupsDontCreateRegions) {
+	const char *PATH = "./test/temp/lookups/";
+	Chunk supposed;
+	supposed.initCC({ 0, 0, 0 });
+	initChunk(supposed, terrainBlock);
+
+	// regions left over from an earlier run would be found
+	boost::filesystem::remove_all(PATH);
+	ChunkArchive archive(PATH);
+	auto numRegionFiles = [PATH]() {
+		int n = 0;
+		boost::filesystem::directory_iterator iter(PATH), end;
+		for (; iter != end; ++iter) {
+			if (iter->path().extension() == ".region")
+				++n;
+		}
+		return n;
+	};
+
+	// asking twice, the second answer comes from memory
+	for (int pass = 0; pass < 2; ++pass) {
+		Chunk actual;
+		actual.initCC({ 100, 0, 0 });
+		EXPECT_FALSE(archive.hasChunk(actual.getCC()));
+		EXPECT_FALSE(archive.loadChunk(&actual));
+		EXPECT_EQ(0, archive.loadChunks({ &actual }));
+		EXPECT_FALSE(actual.isInitialized());
+	}
+	EXPECT_EQ(0, numRegionFiles()) << "Lookups created region files";
+	EXPECT_EQ(0u, archive.getNumOpenRegions());
+
+	// the first store creates the region that was missing before
+	archive.storeChunk(supposed);
+	EXPECT_FALSE(archive.hasChunk({ 1, 0, 0 }));
+	ASSERT_TRUE(archive.checkpoint());
+	EXPECT_EQ(1, numRegionFiles());
+	Chunk actual;
+	actual.initCC(supposed.getCC());
+	ASSERT_TRUE(archive.loadChunk(&actual));
+	EXPECT_EQ(0, getRelativeChunkDifference(supposed, actual));
+}
+
+TEST(ChunkArchiveTest, BatchedLoadsAcrossHoles) {
+	std::vector<Chunk> supposed(48);
+	std::vector<const Chunk *> stored;
+	for (size_t i = 0; i < supposed.size(); ++i) {
+		supposed[i].initCC({ (int64) i % 16, (int64) i / 16, 0 });
+		initChunk(supposed[i], [i](size_t x, size_t y, size_t z, size_t index) {
+			return (uint8) ((terrainBlock(x, y, z, index) + index % (i + 2)) % 9);
+		});
+		stored.push_back(&supposed[i]);
+	}
+
+	ChunkArchive archive("./test/temp/holes/");
+	archive.storeChunks(stored);
+	ASSERT_TRUE(archive.checkpoint());
+	// emptied and shrunk chunks leave holes of all sizes between the others
+	for (size_t i = 0; i < supposed.size(); i += 3) {
+		size_t fill = i % 2;
+		initChunk(supposed[i], [fill](size_t, size_t, size_t, size_t) { return (uint8) fill; });
+		archive.storeChunk(supposed[i]);
+	}
+	ASSERT_TRUE(archive.checkpoint());
+
+	std::vector<size_t> order(supposed.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i * 7 % order.size();
+	IORing ring;
+	for (IORing *r : { (IORing *) nullptr, &ring }) {
+		std::vector<Chunk> actual(supposed.size());
+		std::vector<Chunk *> loaded;
+		for (size_t i : order) {
+			actual[i].initCC(supposed[i].getCC());
+			loaded.push_back(&actual[i]);
+		}
+		EXPECT_EQ((int) supposed.size(), archive.loadChunks(loaded, r));
+		for (size_t i = 0; i < supposed.size(); ++i)
+			EXPECT_EQ(0, getRelativeChunkDifference(supposed[i], actual[i])) << "Chunk " << i;
+	}
+}
@@ -0,0 +1,61 @@
+#include "test/gtest.hpp"
+
+#include "shared/game/chunk.hpp"
+#include "shared/chunk_cache.hpp"
+
+using namespace testing;
+
+TEST(ChunkCacheTest, InsertAndTake) {
+	ChunkCache cache(4);
+	Chunk c1, c2;
+	c1.initCC({ 0, 0, 0 });
+	c2.initCC({ 1, 0, 0 });
+
+	EXPECT_EQ(nullptr, cache.insert(&c1));
+	EXPECT_EQ(nullptr, cache.insert(&c2));
+	EXPECT_EQ(2u, cache.size());
+
+	EXPECT_EQ(nullptr, cache.take({ 2, 0, 0 }));
+	EXPECT_EQ(&c1, cache.take({ 0, 0, 0 }));
+	EXPECT_EQ(nullptr, cache.take({ 0, 0, 0 }));
+	EXPECT_EQ(1u, cache.size());
+}
+
+TEST(ChunkCacheTest, EvictsLeastRecentlyInserted) {
+	ChunkCache cache(2);
+	Chunk c1, c2, c3;
+	c1.initCC({ 0, 0, 0 });
+	c2.initCC({ 1, 0, 0 });
+	c3.initCC({ 2, 0, 0 });
+
+	cache.insert(&c1);
+	cache.insert(&c2);
+	EXPECT_EQ(&c1, cache.insert(&c3)) << "Oldest chunk was not evicted";
+	EXPECT_EQ(2u, cache.size());
+	EXPECT_EQ(&c2, cache.evict());
+	EXPECT_EQ(&c3, cache.evict());
+	EXPECT_EQ(nullptr, cache.evict());
+}
+
+TEST(ChunkCacheTest, KeepsNewestRevision) {
+	ChunkCache cache(4);
+	Chunk older, newer;
+	older.initCC({ 0, 0, 0 });
+	older.initRevision(1);
+	newer.initCC({ 0, 0, 0 });
+	newer.initRevision(2);
+
+	cache.insert(&older);
+	EXPECT_EQ(&older, cache.insert(&newer)) << "Older revision was not displaced";
+	EXPECT_EQ(&older, cache.insert(&older)) << "Older revision displaced a newer one";
+	EXPECT_EQ(1u, cache.size());
+	EXPECT_EQ(&newer, cache.take({ 0, 0, 0 }));
+}
+
+TEST(ChunkCacheTest, ZeroCapacity) {
+	ChunkCache cache(0);
+	Chunk c;
+	c.initCC({ 0, 0, 0 });
+	EXPECT_EQ(&c, cache.insert(&c));
+	EXPECT_EQ(0u, cache.size());
+}
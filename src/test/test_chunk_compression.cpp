@@ -0,0 +1,225 @@
+#include "test/gtest.hpp"
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "shared/engine/std_types.hpp"
+#include "shared/game/chunk.hpp"
+#include "shared/chunk_compression.hpp"
+
+using namespace testing;
+
+// the byte-by-byte implementation the format was defined with, the
+// optimized one has to produce exactly the same bytes
+
+static const uint8 ESCAPE_CHAR = 0xFF;
+
+static int referenceEncode(const uint8 *blocks, uint8 *buffer, size_t size) {
+	uint8 cur_run_type = blocks[0];
+	size_t cur_run_length = 1;
+	uint8 *head = buffer;
+
+	auto finishRun = [&]() -> int {
+		if (cur_run_length == 0)
+			return 0;
+		if (cur_run_length > 3 || cur_run_type == ESCAPE_CHAR) {
+			if (cur_run_length < 0x80) {
+				if ((uint) (head - buffer) + 3u > size)
+					return -1;
+				*head++ = ESCAPE_CHAR;
+				*head++ = cur_run_length & 0xFF;
+				*head++ = cur_run_type;
+			} else {
+				size_t encoded_run_length = cur_run_length - 1;
+				if ((uint) (head - buffer) + 4u > size)
+					return -1;
+				*head++ = ESCAPE_CHAR;
+				*head++ = ((encoded_run_length >> 8) & 0xFF) | 0x80;
+				*head++ = encoded_run_length & 0xFF;
+				*head++ = cur_run_type;
+			}
+		} else {
+			if (head - buffer + cur_run_length > size)
+				return -1;
+			for (size_t j = 0; j < cur_run_length; ++j)
+				*head++ = cur_run_type;
+		}
+		return 0;
+	};
+
+	for (size_t i = 1; i < size; ++i) {
+		uint8 next_block = blocks[i];
+		if (cur_run_length >= 0x8000) {
+			if (finishRun() != 0)
+				return (int) (head - buffer);
+			cur_run_length = 0;
+		}
+		if (cur_run_type == next_block) {
+			cur_run_length++;
+		} else {
+			if (finishRun() != 0)
+				return (int) (head - buffer);
+			cur_run_type = next_block;
+			cur_run_length = 1;
+		}
+	}
+
+	finishRun();
+	return (int) (head - buffer);
+}
+
+static void referenceDecode(const uint8 *encoded, size_t size, uint8 *blocks) {
+	size_t index = 0;
+	while (index < Chunk::SIZE) {
+		if (size < 1)
+			return;
+		uint8 next_block = *encoded++;
+		size--;
+		if (next_block != ESCAPE_CHAR) {
+			blocks[index++] = next_block;
+			continue;
+		}
+
+		if (size < 1)
+			return;
+		uint8 next_byte = *encoded++;
+		size--;
+		uint32 run_length;
+		if ((next_byte & 0x80) == 0) {
+			run_length = next_byte;
+		} else {
+			uint32 encoded_run_length = next_byte & 0x7F;
+			if (size < 1)
+				return;
+			encoded_run_length = (encoded_run_length << 8) | *encoded++;
+			size--;
+			run_length = encoded_run_length + 1;
+		}
+		if (size < 1)
+			return;
+		uint8 block_type = *encoded++;
+		size--;
+		for (uint32 i = 0; i < run_length && index < Chunk::SIZE; ++i)
+			blocks[index++] = block_type;
+	}
+}
+
+static std::vector<uint8> makeRandomBlocks(std::mt19937 *random) {
+	std::uniform_int_distribution<int> byteDist(0, 255);
+	std::vector<uint8> blocks(Chunk::SIZE);
+	for (size_t i = 0; i < blocks.size(); ++i)
+		blocks[i] = (uint8) byteDist(*random);
+	return blocks;
+}
+
+// runs of a few types, escape characters included, with lengths up to
+// maxRunLength
+static std::vector<uint8> makeRunBlocks(std::mt19937 *random, int maxRunLength) {
+	static const uint8 TYPES[] = { 0, 1, 2, 3, ESCAPE_CHAR };
+	std::uniform_int_distribution<int> typeDist(0, 4);
+	std::uniform_int_distribution<int> lengthDist(1, maxRunLength);
+	std::vector<uint8> blocks;
+	while (blocks.size() < Chunk::SIZE) {
+		uint8 type = TYPES[typeDist(*random)];
+		blocks.insert(blocks.end(), lengthDist(*random), type);
+	}
+	blocks.resize(Chunk::SIZE);
+	return blocks;
+}
+
+static std::vector<std::vector<uint8>> makeTestBlocks() {
+	std::mt19937 random(42);
+	std::vector<std::vector<uint8>> result;
+	result.push_back(std::vector<uint8>(Chunk::SIZE, 0));
+	result.push_back(std::vector<uint8>(Chunk::SIZE, ESCAPE_CHAR));
+	for (int i = 0; i < 4; ++i)
+		result.push_back(makeRandomBlocks(&random));
+	for (int maxRunLength : { 2, 5, 40, 300, 5000 }) {
+		for (int i = 0; i < 4; ++i)
+			result.push_back(makeRunBlocks(&random, maxRunLength));
+	}
+	return result;
+}
+
+static std::vector<uint8> encode(const std::vector<uint8> &blocks, size_t size,
+		int (*encoder)(const uint8 *, uint8 *, size_t)) {
+	std::vector<uint8> buffer(size + 4, 0xAB);
+	int length = encoder(blocks.data(), buffer.data(), size);
+	EXPECT_LE((size_t) length, size);
+	buffer.resize(length);
+	return buffer;
+}
+
+TEST(ChunkCompressionTest, EncodingMatchesReference) {
+	for (const auto &blocks : makeTestBlocks()) {
+		for (size_t size : { (size_t) Chunk::SIZE, (size_t) 4097, (size_t) 100, (size_t) 5, (size_t) 1 }) {
+			ASSERT_EQ(encode(blocks, size, referenceEncode), encode(blocks, size, encodeBlocks_RLE));
+		}
+	}
+}
+
+TEST(ChunkCompressionTest, DecodingMatchesReference) {
+	for (const auto &blocks : makeTestBlocks()) {
+		std::vector<uint8> encoded = encode(blocks, Chunk::SIZE, referenceEncode);
+		if (encoded.size() + 4 > Chunk::SIZE)
+			continue; // might not have fit, would be stored plainly
+
+		std::vector<uint8> decoded(Chunk::SIZE, 0);
+		decodeBlocks_RLE(encoded.data(), encoded.size(), decoded.data());
+		ASSERT_EQ(blocks, decoded);
+
+		// the stream has to end up right behind the encoded data
+		std::string data(encoded.begin(), encoded.end());
+		data += "trailer";
+		std::istringstream is(data);
+		std::vector<uint8> streamDecoded(Chunk::SIZE, 0);
+		decodeBlocks_RLE(&is, streamDecoded.data());
+		ASSERT_TRUE(is.good());
+		ASSERT_EQ(blocks, streamDecoded);
+		std::string trailer;
+		is >> trailer;
+		ASSERT_EQ("trailer", trailer);
+	}
+}
+
+TEST(ChunkCompressionTest, StreamEndingWithChunk) {
+	std::mt19937 random(7);
+	std::vector<uint8> blocks = makeRunBlocks(&random, 40);
+	std::vector<uint8> encoded = encode(blocks, Chunk::SIZE, referenceEncode);
+	std::istringstream is(std::string(encoded.begin(), encoded.end()));
+	std::vector<uint8> decoded(Chunk::SIZE, 0);
+	decodeBlocks_RLE(&is, decoded.data());
+	EXPECT_TRUE(is.good());
+	EXPECT_EQ(blocks, decoded);
+}
+
+TEST(ChunkCompressionTest, TruncatedInput) {
+	std::mt19937 random(3);
+	std::vector<uint8> blocks = makeRunBlocks(&random, 40);
+	std::vector<uint8> encoded = encode(blocks, Chunk::SIZE, referenceEncode);
+	for (size_t size = 0; size < encoded.size(); size += 1 + size / 8) {
+		std::vector<uint8> expected(Chunk::SIZE, 0x11);
+		referenceDecode(encoded.data(), size, expected.data());
+		std::vector<uint8> decoded(Chunk::SIZE, 0x11);
+		decodeBlocks_RLE(encoded.data(), size, decoded.data());
+		ASSERT_EQ(expected, decoded);
+
+		std::istringstream is(std::string(encoded.begin(), encoded.begin() + size));
+		decodeBlocks_RLE(&is, decoded.data());
+		ASSERT_FALSE(is.good());
+	}
+}
+
+TEST(ChunkCompressionTest, OversizedRunIsClamped) {
+	std::vector<uint8> encoded(Chunk::SIZE - 10, 5);
+	uint8 run[] = { ESCAPE_CHAR, 0x80 | 0x01, 0x00, 7 };
+	encoded.insert(encoded.end(), run, run + sizeof(run));
+	std::vector<uint8> expected(Chunk::SIZE);
+	referenceDecode(encoded.data(), encoded.size(), expected.data());
+	std::vector<uint8> decoded(Chunk::SIZE);
+	decodeBlocks_RLE(encoded.data(), encoded.size(), decoded.data());
+	EXPECT_EQ(expected, decoded);
+	EXPECT_EQ(7, decoded[Chunk::SIZE - 1]);
+}
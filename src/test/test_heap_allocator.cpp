@@ -0,0 +1,74 @@
+#include "test/gtest.hpp"
+
+#include <random>
+#include <vector>
+
+#include "shared/engine/std_types.hpp"
+#include "shared/heap_allocator.hpp"
+
+using namespace testing;
+
+typedef HeapAllocator::Extent Extent;
+
+TEST(HeapAllocatorTest, RebuildFindsHoles) {
+	HeapAllocator heap;
+	heap.rebuild({ Extent(4, 2), Extent(0, 1), Extent(10, 3) }, 16);
+	EXPECT_EQ(16u, heap.getEnd());
+	EXPECT_EQ(10u, heap.getNumFreeBlocks());
+
+	// smallest hole first
+	EXPECT_EQ(6u, heap.allocate(4));
+	EXPECT_EQ(1u, heap.allocate(3));
+	EXPECT_EQ(13u, heap.allocate(3));
+	EXPECT_EQ(0u, heap.getNumFreeBlocks());
+	EXPECT_EQ(16u, heap.allocate(2));
+	EXPECT_EQ(18u, heap.getEnd());
+}
+
+TEST(HeapAllocatorTest, FreeMergesNeighbors) {
+	HeapAllocator heap;
+	heap.rebuild({}, 0);
+	uint32 a = heap.allocate(2);
+	uint32 b = heap.allocate(3);
+	uint32 c = heap.allocate(1);
+	heap.allocate(1);
+	heap.free(a, 2);
+	heap.free(c, 1);
+	heap.free(b, 3);
+	EXPECT_EQ(6u, heap.getNumFreeBlocks());
+	EXPECT_EQ(a, heap.allocate(6));
+	EXPECT_EQ(7u, heap.getEnd());
+}
+
+TEST(HeapAllocatorTest, HoleAtEndIsExtended) {
+	HeapAllocator heap;
+	heap.rebuild({ Extent(0, 4) }, 6);
+	EXPECT_EQ(4u, heap.allocate(5));
+	EXPECT_EQ(9u, heap.getEnd());
+}
+
+TEST(HeapAllocatorTest, ChurnStaysBounded) {
+	std::minstd_rand rng;
+	rng.seed(3);
+	std::uniform_int_distribution<uint32> sizes(1, 16);
+
+	HeapAllocator heap;
+	heap.rebuild({}, 0);
+	std::vector<Extent> live;
+	for (int i = 0; i < 64; ++i) {
+		uint32 size = sizes(rng);
+		live.push_back(Extent(heap.allocate(size), size));
+	}
+	for (int i = 0; i < 10000; ++i) {
+		Extent &extent = live[rng() % live.size()];
+		heap.free(extent.first, extent.second);
+		extent.second = sizes(rng);
+		extent.first = heap.allocate(extent.second);
+	}
+
+	uint32 used = 0;
+	for (const Extent &extent : live)
+		used += extent.second;
+	EXPECT_EQ(heap.getEnd(), used + heap.getNumFreeBlocks());
+	EXPECT_LT(heap.getEnd(), 64u * 16u * 2u);
+}
@@ -0,0 +1,105 @@
+#include "test/gtest.hpp"
+
+#include <vector>
+
+#include "shared/engine/std_types.hpp"
+#include "shared/game/chunk.hpp"
+#include "shared/net.hpp"
+
+using namespace testing;
+
+static const uint32 REVISIONS[] = { 0, 1, 7, 8, 255, 256, 70000, 0x12345678, 0xFFFFFFFF };
+static const size_t NUM_REVISIONS = sizeof(REVISIONS) / sizeof(REVISIONS[0]);
+
+template <typename T>
+std::vector<char> serialize(const T &msg) {
+	std::vector<char> buffer(getMessageSize(msg));
+	EXPECT_EQ(BUFFER_OK, writeMessage(msg, buffer.data(), buffer.size()));
+	return buffer;
+}
+
+TEST(NetTest, ChunkRequestRevisions) {
+	ChunkRequest msg;
+	msg.numChunks = NUM_REVISIONS + 1;
+	for (uint i = 0; i < msg.numChunks; ++i) {
+		msg.chunkRequestData[i].relCoords = vec3i64(i % 8, -(int64) (i % 8), 3);
+		msg.chunkRequestData[i].cached = i < NUM_REVISIONS;
+		msg.chunkRequestData[i].cachedRevision = i < NUM_REVISIONS ? REVISIONS[i] : 0;
+	}
+
+	std::vector<char> buffer = serialize(msg);
+	ChunkRequest read;
+	ASSERT_EQ(MESSAGE_OK, readMessageBody(buffer.data(), buffer.size(), &read));
+	ASSERT_EQ(msg.numChunks, read.numChunks);
+	for (uint i = 0; i < msg.numChunks; ++i) {
+		EXPECT_EQ(msg.chunkRequestData[i].relCoords, read.chunkRequestData[i].relCoords);
+		EXPECT_EQ(msg.chunkRequestData[i].cached, read.chunkRequestData[i].cached);
+		if (msg.chunkRequestData[i].cached) {
+			EXPECT_EQ(msg.chunkRequestData[i].cachedRevision, read.chunkRequestData[i].cachedRevision);
+		}
+	}
+}
+
+TEST(NetTest, ChunkMessageRevisions) {
+	uint8 encoded[64];
+	for (size_t i = 0; i < sizeof(encoded); ++i)
+		encoded[i] = (uint8) i;
+
+	ChunkMessage msg;
+	msg.numChunks = NUM_REVISIONS;
+	msg.encodedBuffer = encoded;
+	for (uint i = 0; i < msg.numChunks; ++i) {
+		msg.chunkMessageData[i].relCoords = vec3i64(-1, 2, -(int64) i % 8);
+		msg.chunkMessageData[i].revision = REVISIONS[i];
+		msg.chunkMessageData[i].encodedLength = i;
+	}
+
+	std::vector<char> buffer = serialize(msg);
+	uint8 decoded[64];
+	ChunkMessage read;
+	read.encodedBuffer = decoded;
+	ASSERT_EQ(MESSAGE_OK, readMessageBody(buffer.data(), buffer.size(), &read));
+	ASSERT_EQ(msg.numChunks, read.numChunks);
+	size_t offset = 0;
+	for (uint i = 0; i < msg.numChunks; ++i) {
+		EXPECT_EQ(msg.chunkMessageData[i].relCoords, read.chunkMessageData[i].relCoords);
+		EXPECT_EQ(REVISIONS[i], read.chunkMessageData[i].revision);
+		ASSERT_EQ((size_t) i, read.chunkMessageData[i].encodedLength);
+		for (uint j = 0; j < i; ++j)
+			EXPECT_EQ(encoded[offset + j], decoded[offset + j]);
+		offset += i;
+	}
+}
+
+TEST(NetTest, ChunkDeltaMessage) {
+	std::vector<ChunkEdit> edits;
+	ChunkDeltaMessage msg;
+	msg.numChunks = NUM_REVISIONS;
+	for (uint i = 0; i < msg.numChunks; ++i) {
+		msg.chunkDeltaData[i].relCoords = vec3i64(i % 8, 7, -8);
+		msg.chunkDeltaData[i].revision = REVISIONS[i];
+		msg.chunkDeltaData[i].numEdits = i * 7 % MAX_EDITS_PER_CHUNK_DELTA;
+		for (uint j = 0; j < msg.chunkDeltaData[i].numEdits; ++j)
+			edits.push_back(ChunkEdit{0, (uint16) (j * 4099 % Chunk::SIZE), (uint8) (i + j)});
+	}
+	msg.edits = edits.data();
+
+	std::vector<char> buffer = serialize(msg);
+	std::vector<ChunkEdit> readEdits(MAX_EDITS_PER_CHUNK_DELTA * MAX_CHUNKS_PER_MESSAGE);
+	ChunkDeltaMessage read;
+	read.edits = readEdits.data();
+	ASSERT_EQ(MESSAGE_OK, readMessageBody(buffer.data(), buffer.size(), &read));
+	ASSERT_EQ(msg.numChunks, read.numChunks);
+	size_t e = 0;
+	for (uint i = 0; i < msg.numChunks; ++i) {
+		EXPECT_EQ(msg.chunkDeltaData[i].relCoords, read.chunkDeltaData[i].relCoords);
+		EXPECT_EQ(REVISIONS[i], read.chunkDeltaData[i].revision);
+		ASSERT_EQ(msg.chunkDeltaData[i].numEdits, read.chunkDeltaData[i].numEdits);
+		for (uint j = 0; j < msg.chunkDeltaData[i].numEdits; ++j, ++e) {
+			EXPECT_EQ(edits[e].index, readEdits[e].index);
+			EXPECT_EQ(edits[e].type, readEdits[e].type);
+		}
+	}
+
+	EXPECT_EQ(ABRUPT_MESSAGE_END, readMessageBody(buffer.data(), buffer.size() - 1, &read));
+}
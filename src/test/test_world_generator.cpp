@@ -0,0 +1,180 @@
+#include "test/gtest.hpp"
+#include "test/spawn_chunks.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "shared/engine/std_types.hpp"
+#include "shared/engine/time.hpp"
+#include "shared/game/chunk.hpp"
+#include "shared/game/perlin.hpp"
+#include "shared/game/world_generator.hpp"
+#include "shared/async_world_generator.hpp"
+#include "shared/block_utils.hpp"
+
+using namespace testing;
+
+namespace {
+
+// FNV-1a, the expected hashes below were taken from the scalar noise code
+uint64 hashBytes(const void *data, size_t size) {
+	const uint8 *bytes = (const uint8 *) data;
+	uint64 hash = 1469598103934665603ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// writes a vertical slice through two versions of the same blocks as a
+// picture, blocks that are solid in only one of them are red or green
+void writeSliceDiff(const char *path, const std::vector<uint8> &expected,
+		const std::vector<uint8> &actual, uint width, uint height) {
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return;
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+	for (uint z = height; z-- > 0;)
+	for (uint x = 0; x < width; ++x) {
+		uint8 a = expected[z * width + x];
+		uint8 b = actual[z * width + x];
+		bool solidA = a != 0 && a != 62;
+		bool solidB = b != 0 && b != 62;
+		uint8 pixel[3] = {0, 0, 0};
+		if (solidA && !solidB)
+			pixel[0] = 255;
+		else if (solidB && !solidA)
+			pixel[1] = 255;
+		else if (solidA)
+			pixel[0] = pixel[1] = pixel[2] = 128;
+		else if (a == 62)
+			pixel[2] = 160;
+		fwrite(pixel, 1, 3, file);
+	}
+	fclose(file);
+}
+
+} // namespace
+
+// existing worlds depend on the noise staying the same bit for bit, no
+// matter which vector instructions it was built with
+TEST(WorldGeneratorTest, NoiseGridsAreDeterministic) {
+	Perlin perlin(1234);
+	std::vector<double> buffer(33 * 17 * 9);
+
+	// several points per cell, with rows that don't fill whole vectors
+	perlin.noise3(-12.345, 6.789, -0.5, 1.0 / 37, 1.0 / 23, 1.0 / 11, 33, 17, 9,
+			3, 0.4, 2.0, buffer.data());
+	EXPECT_EQ(0xb2b112e3e98cd47full, hashBytes(buffer.data(), buffer.size() * sizeof(double)));
+
+	// a cell for every point
+	perlin.noise3(-12.345, 6.789, -0.5, 0.7, 0.9, 1.3, 33, 17, 9,
+			2, 0.4, 2.0, buffer.data());
+	EXPECT_EQ(0x4984f39cd3345490ull, hashBytes(buffer.data(), buffer.size() * sizeof(double)));
+
+	perlin.noise2(100.25, -3.5, 1.0 / 29, 1.0 / 31, 33, 17,
+			4, 0.4, 2.5, buffer.data());
+	EXPECT_EQ(0xc1a8574e934bac79ull, hashBytes(buffer.data(), 33 * 17 * sizeof(double)));
+}
+
+TEST(WorldGeneratorTest, TerrainIsDeterministic) {
+	WorldGenerator generator(42, WorldParams());
+
+	uint64 hash = 1469598103934665603ull;
+	std::vector<uint8> blocks(Chunk::SIZE);
+	for (Chunk *chunk : makeSpawnChunks(&generator, { -1, -1, -3 }, { 0, 0, 1 })) {
+		chunk->getBlocks(blocks.data());
+		for (uint8 block : blocks) {
+			hash ^= block;
+			hash *= 1099511628211ull;
+		}
+		delete chunk;
+	}
+	EXPECT_EQ(0x97d0d683f4944f7full, hash) << "Generated terrain changed, "
+			"WorldGenerator::VERSION needs to change as well";
+}
+
+TEST(WorldGeneratorTest, AsyncMatchesSequential) {
+	WorldGenerator generator(42, WorldParams());
+	std::vector<Chunk *> chunks = makeSpawnChunks(&generator, { -2, -2, -3 }, { 1, 1, 1 }, false);
+
+	// the workers share the generator and its elevation cache
+	size_t numGenerated = 0;
+	{
+		AsyncWorldGenerator asyncGenerator(&generator, 4);
+		EXPECT_EQ(4, asyncGenerator.getNumWorkers());
+		size_t numRequested = 0;
+		Time timeout = getCurrentTime() + seconds(60);
+		while (numGenerated < chunks.size() && getCurrentTime() < timeout) {
+			while (numRequested < chunks.size() && asyncGenerator.generateChunk(chunks[numRequested]))
+				numRequested++;
+			Chunk *chunk;
+			while ((chunk = asyncGenerator.getNextChunk()) != nullptr) {
+				EXPECT_TRUE(chunk->isInitialized());
+				numGenerated++;
+			}
+			sleepFor(millis(1));
+		}
+	}
+	ASSERT_EQ(chunks.size(), numGenerated);
+
+	std::vector<uint8> expected(Chunk::SIZE);
+	std::vector<uint8> actual(Chunk::SIZE);
+	for (Chunk *chunk : chunks) {
+		Chunk reference(Chunk::VISUAL);
+		reference.initCC(chunk->getCC());
+		generator.generateChunk(&reference);
+		reference.getBlocks(expected.data());
+		chunk->getBlocks(actual.data());
+		vec3i64 cc = chunk->getCC();
+		EXPECT_EQ(0, memcmp(expected.data(), actual.data(), Chunk::SIZE))
+				<< "Chunk " << cc[0] << "," << cc[1] << "," << cc[2];
+		delete chunk;
+	}
+}
+
+// the interpolated cave fields should hardly move any caves, the slice in
+// test/temp/ shows where they did
+TEST(WorldGeneratorTest, CoarseCavesLookAlike) {
+	WorldParams coarseParams;
+	coarseParams.caveSampleStride = 4;
+	WorldGenerator exactGenerator(42, WorldParams());
+	WorldGenerator coarseGenerator(42, coarseParams);
+	std::vector<Chunk *> exactChunks = makeSpawnChunks(&exactGenerator, { -2, 0, -3 }, { 1, 0, 0 });
+	std::vector<Chunk *> coarseChunks = makeSpawnChunks(&coarseGenerator, { -2, 0, -3 }, { 1, 0, 0 });
+
+	const uint width = 4 * Chunk::WIDTH;
+	const uint height = 4 * Chunk::WIDTH;
+	std::vector<uint8> exactSlice(width * height);
+	std::vector<uint8> coarseSlice(width * height);
+	std::vector<uint8> exact(Chunk::SIZE);
+	std::vector<uint8> coarse(Chunk::SIZE);
+	size_t numBlocks = 0;
+	size_t numDifferent = 0;
+	for (size_t c = 0; c < exactChunks.size(); ++c) {
+		exactChunks[c]->getBlocks(exact.data());
+		coarseChunks[c]->getBlocks(coarse.data());
+		delete exactChunks[c];
+		delete coarseChunks[c];
+		for (size_t i = 0; i < Chunk::SIZE; ++i)
+			numDifferent += exact[i] != coarse[i];
+		numBlocks += Chunk::SIZE;
+
+		// the slice through the middle of the chunks, four of them per row
+		size_t x = c % 4;
+		size_t z = c / 4;
+		for (uint iccz = 0; iccz < Chunk::WIDTH; ++iccz)
+		for (uint iccx = 0; iccx < Chunk::WIDTH; ++iccx) {
+			size_t index = (iccz * Chunk::WIDTH + Chunk::WIDTH / 2) * Chunk::WIDTH + iccx;
+			size_t sliceIndex = (z * Chunk::WIDTH + iccz) * width + x * Chunk::WIDTH + iccx;
+			exactSlice[sliceIndex] = exact[index];
+			coarseSlice[sliceIndex] = coarse[index];
+		}
+	}
+	writeSliceDiff("./test/temp/caves_stride4.ppm", exactSlice, coarseSlice, width, height);
+
+	EXPECT_LT(numDifferent, numBlocks / 1000) << "Interpolated caves differ in "
+			<< numDifferent << " of " << numBlocks << " blocks";
+}
@@ -0,0 +1,38 @@
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "shared/engine/logging.hpp"
+#include "shared/chunk_archive.hpp"
+#include "shared/saves.hpp"
+
+static logging::Logger logger("compact");
+
+// Compacts the region files of a world in saves/<id>/, the world must not
+// be in use by a server or client
+int main(int argc, char *argv[]) {
+	if (argc < 2 || argc > 3) {
+		printf("Usage: %s <world id> [min fragmentation]\n", argv[0]);
+		return 1;
+	}
+
+	logging::init("logging_srv.conf");
+
+	Save save(argv[1]);
+	if (!save.isGood())
+		return 1;
+	if (!save.lock()) {
+		LOG_ERROR(logger) << "World '" << argv[1] << "' is in use";
+		return 1;
+	}
+	float min_fragmentation = argc == 3 ? (float) atof(argv[2]) : 0.0f;
+
+	// the archive replays what is left in its journal, which needs the
+	// world's compression and generator
+	std::unique_ptr<ChunkArchive> archive = save.getChunkArchive();
+	int num_compacted = archive->compactRegions(min_fragmentation, -1, 0, true);
+	LOG_INFO(logger) << "Compacted " << num_compacted << " region files";
+
+	return 0;
+}